@@ -49,6 +49,12 @@ static Color colors[] = {
 #define NMASTER 1
 /* scroll back buffer size in lines */
 #define SCROLL_HISTORY 500
+/* bytes of scroll back content of all windows together, when exceeded the
+ * oldest lines of any window are dropped first. 0 for no limit */
+#define SCROLL_BUDGET (32 << 20)
+/* delay in ms before size changes are applied to the screen and signalled
+ * to applications, resizes within this delay are coalesced */
+#define RESIZE_DELAY 50
 /* printf format string for the tag in the status bar */
 #define TAG_SYMBOL   "[%s%s%s]"
 /* curses attributes for the currently selected tags */
@@ -73,6 +79,7 @@ static Layout layouts[] = {
 	{ "+++", grid },
 	{ "TTT", bstack },
 	{ "[ ]", fullscreen },
+	{ "[|]", splittree },
 };
 
 #define MOD  CTRL('g')
@@ -116,6 +123,10 @@ static KeyBinding bindings[] = {
 	{ { MOD, 'f',          }, { setlayout,      { "[]=" }                   } },
 	{ { MOD, 'g',          }, { setlayout,      { "+++" }                   } },
 	{ { MOD, 'b',          }, { setlayout,      { "TTT" }                   } },
+	{ { MOD, 'w',          }, { setlayout,      { "[|]" }                   } },
+	{ { MOD, '|',          }, { split,          { "h" }                     } },
+	{ { MOD, '-',          }, { split,          { "v" }                     } },
+	{ { MOD, 'y',          }, { split,          { "swap" }                  } },
 	{ { MOD, 'm',          }, { togglemaximize, { NULL }                    } },
 	{ { MOD, ' ',          }, { setlayout,      { NULL }                    } },
 	{ { MOD, 'i',          }, { incnmaster,     { "+1" }                    } },
@@ -153,7 +164,7 @@ static KeyBinding bindings[] = {
 	{ { MOD, KEY_PPAGE,    }, { scrollback,     { "-1" }                    } },
 	{ { MOD, KEY_NPAGE,    }, { scrollback,     { "1"  }                    } },
 	{ { MOD, '?',          }, { create,         { "man dvtm", "dvtm help" } } },
-	{ { MOD, MOD,          }, { send,           { (const char []){MOD, 0} } } },
+	{ { MOD, MOD,          }, { sendkeys,       { (const char []){MOD, 0} } } },
 	{ { KEY_SPREVIOUS,     }, { scrollback,     { "-1" }                    } },
 	{ { KEY_SNEXT,         }, { scrollback,     { "1"  }                    } },
 	{ { MOD, '0',          }, { view,           { NULL }                    } },
@@ -219,6 +230,9 @@ static const ColorRule colorrules[] = {
 
 #define ENABLE_MOUSE true /* whether to enable mouse events by default */
 
+/* detaches the terminal from a session attached to with -a */
+#define DETACH_KEY CTRL('\\')
+
 #ifdef CONFIG_MOUSE
 static Button buttons[] = {
 	{ BUTTON1_CLICKED,        { mouse_focus,      { NULL  } } },
@@ -247,16 +261,41 @@ static Cmd commands[] = {
 	{ "setcwd", { setcwd, { NULL } } },
 	/* change layout by name or select next */
 	{ "setlayout", { setlayout, { NULL } } },
-	/* status bar */
+	/* split h|v|auto|swap: side by side or stacked next split, swap the focused split */
+	{ "split", { split, { NULL } } },
+	/* status bar: align left|right, stats on|off */
 	{ "setstatus", { setstatus, { NULL } } },
 	{ "setminimized", { setminimized, { NULL } } },
 	{ "tagname", { tagname, { NULL } } },
 	{ "tagnamebycwd", { tagnamebycwd, { NULL } } },
 	{ "view", { view, { NULL } } },
 	{ "kill", { killclient, { NULL } } },
+	/* copybuf put [reg] [len] | get [reg] | list: registers are a-z and 0-9, the
+	 * history of the default one. getfd [reg] and putfd [reg] pass a file over
+	 * the command socket instead */
 	{ "copybuf", { copybuf, { NULL } } },
+	/* paste [reg]: paste a register into the focused window */
+	{ "paste", { paste, { NULL } } },
+	/* sendtext <text> | - [len] [paste], - reads len bytes from the copy fifo */
 	{ "sendtext", { sendtext, { NULL } } },
+	/* send <keys>: the key action is called sendkeys, send is kept as its former name */
+	{ "send", { sendkeys, { NULL } } },
 	{ "capture", { capture, { NULL } } },
+	/* region <win_id> <row> [nrows] [col] [ncols] [color]: print part of the window, negative rows address the scrollback */
+	{ "region", { region, { NULL } } },
+	/* tap <win_id> <file|'|command'> [drop|throttle], tap <win_id> off: copy the output of a window */
+	{ "tap", { tap, { NULL } } },
+	/* stats [win_id]: print throughput and latency counters of all or the given window */
+	{ "stats", { stats, { NULL } } },
+	/* trace [on|off|reset|dump]: key press to screen latency histograms */
+	{ "trace", { tracelatency, { NULL } } },
+	/* subscribe [all|focus|title|urgent|tag|create|destroy|user ...]: select the events to receive */
+	{ "subscribe", { subscribe, { NULL } } },
+	/* begin, commit: defer re-arranging and redrawing until the outermost commit,
+	 * a batch of the command FIFO is committed after each read, one of a socket
+	 * connection stays open across requests until committed or disconnected */
+	{ "begin", { batchbegin, { NULL } } },
+	{ "commit", { batchcommit, { NULL } } },
 	{ "exec", { doexec, { NULL } } },
 };
 
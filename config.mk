@@ -12,3 +12,7 @@ CPPFLAGS = -D_POSIX_C_SOURCE=200809L -D_XOPEN_SOURCE=700 -D_XOPEN_SOURCE_EXTENDE
 CFLAGS += -std=c99 ${INCS} -DNDEBUG ${CPPFLAGS}
 
 CC ?= cc
+
+# compiler and flags used for the fuzzing targets (make fuzz, vt-fuzz-libfuzzer)
+FUZZ_CC = clang
+FUZZ_CFLAGS = -g -fsanitize=address,undefined -fno-omit-frame-pointer
@@ -17,11 +17,16 @@
 #include <limits.h>
 #include <libgen.h>
 #include <sys/select.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <termios.h>
+#include <time.h>
 #include <fcntl.h>
 #include <curses.h>
 #include <stdio.h>
@@ -51,20 +56,85 @@ typedef struct {
 	int w;
 	int h;
 	volatile sig_atomic_t need_resize;
+	uint64_t resize_ns;      /* when to apply the pending resize */
 } Screen;
 
+typedef struct {
+	int x, y, w, h;
+} Rect;
+
+/* a layout computes the geometry of n tiled windows within the given area,
+ * the separators between them are drawn by draw_separators() */
 typedef struct {
 	const char *symbol;
-	void (*arrange)(void);
+	void (*arrange)(Rect *r, unsigned int n, unsigned int nmaster, float mfact, Rect area);
 } Layout;
 
+/* the last geometry computed for a tag and what it depends on */
+typedef struct {
+	Layout *layout;
+	unsigned int n, nmaster;
+	float mfact;
+	Rect area;
+	Rect *rects;
+	unsigned int size;       /* allocated rects */
+} LayoutCache;
+
+typedef struct {
+	uint64_t process_ns;     /* time spent in vt_process */
+	uint64_t draw_ns;        /* time spent in vt_draw */
+	uint64_t input_ns;       /* time stamp of oldest input not yet echoed */
+	uint64_t latency_ns;     /* sum of input to echo latencies */
+	uint64_t latency_max_ns;
+	unsigned long latency_count;
+	uint64_t trace_key_ns;   /* time stamp of the traced key press */
+	uint64_t trace_read_ns;  /* time stamp of the pty read following it */
+} ClientStats;
+
+/* maximal amount of tapped output waiting to be written */
+#define TAP_QUEUE_MAX (1 << 20)
+
+typedef struct {
+	char *data;
+	size_t len;
+	size_t size;
+} Register;
+
+/* the copy register is kept as a list of chunks, input is read directly
+ * into them and pasted one chunk after the other */
+#define CHUNK_SIZE (64 << 10)
+
+typedef struct Chunk Chunk;
+struct Chunk {
+	Chunk *next;
+	size_t len;
+	char data[CHUNK_SIZE];
+};
+
+typedef struct {
+	Chunk *head, *tail;
+	size_t len;
+} Rope;
+
+typedef struct Tap Tap;
+struct Tap {
+	int fd;                  /* pipe to the process storing the output */
+	pid_t pid;
+	bool throttle;           /* stop reading from the pane instead of dropping output */
+	Register queue;          /* output not yet written to the pipe */
+	unsigned long long dropped;
+	Tap *next;               /* closed taps still draining their queue */
+};
+
 typedef struct Client Client;
+typedef struct Split Split;
 struct Client {
-	WINDOW *window;
+	WINDOW *window;          /* only while on a viewed tag */
 	Vt *term;
 	Vt *overlay, *app;
 	bool is_editor;
 	int editor_fds[2];
+	Rope edited;             /* editor output read so far */
 	volatile sig_atomic_t overlay_died;
 	const char *cmd;
 	char title[255];
@@ -77,6 +147,9 @@ struct Client {
 	unsigned short int w;
 	unsigned short int h;
 	bool has_title_line;
+	bool arranged;           /* visible at the last arrange() */
+	bool moved;              /* geometry changed since the last arrange() */
+	Split *leaf;             /* in the split tree of the current tag */
 	bool minimized;
 	bool urgent;
 	volatile sig_atomic_t died;
@@ -84,6 +157,35 @@ struct Client {
 	Client *prev;
 	Client *snext;
 	unsigned int tags;
+	uint64_t winsize_ns;     /* when to announce the changed size */
+	ClientStats stats;
+	Tap *tap;
+};
+
+/* the split tree layout keeps a binary tree per tag, its leaves are the
+ * tiled windows, inner nodes divide their area between both children */
+struct Split {
+	Split *parent, *child[2];
+	Client *client;          /* of leaves */
+	bool vertical;           /* children side by side, with a separator */
+	float ratio;             /* share of the first child */
+	Rect rect;               /* area at the last arrange() */
+	bool dirty;              /* ratio or children changed since */
+};
+
+/* stop reading the copy fifo while this much input is waiting for the pty */
+#define TRANSFER_QUEUE_MAX (1 << 20)
+
+/* data announced for the copy fifo, transfers are served in the order they
+ * were announced and without receiver the data is discarded */
+typedef struct Transfer Transfer;
+struct Transfer {
+	Client *client;          /* receiver of the data, NULL once it is gone */
+	Rope *rope;              /* or the register storing it */
+	char reg[2];             /* name of that register until the transfer starts */
+	size_t left;             /* bytes still expected on the copy fifo */
+	bool paste;              /* wrapped in bracketed paste sequences */
+	Transfer *next;          /* announced after this one */
 };
 
 typedef struct {
@@ -126,6 +228,20 @@ typedef struct {
 	Action action;
 } KeyBinding;
 
+/* hash index over all key prefixes of a binding array, every prefix maps
+ * to the first binding starting with it */
+typedef struct {
+	int binding;         /* index into the binding array, -1 if unused */
+	unsigned int count;  /* prefix length */
+} KeyIndexSlot;
+
+typedef struct {
+	KeyBinding *bindings;
+	unsigned int n;
+	KeyIndexSlot *slots;
+	unsigned int size;   /* number of slots, a power of two */
+} KeyIndex;
+
 typedef struct {
 	mmask_t mask;
 	Action action;
@@ -136,6 +252,23 @@ typedef struct {
 	Action action;
 } Cmd;
 
+typedef struct {
+	int *slots;          /* indices into commands[], -1 if unused */
+	unsigned int size;   /* number of slots, a power of two */
+} CmdIndex;
+
+typedef struct {
+	int key;
+	void *value;         /* NULL marks an unused slot */
+} IntMapEntry;
+
+/* open addressing hash map from integers to pointers */
+typedef struct {
+	IntMapEntry *entries;
+	unsigned int size;   /* number of slots, zero or a power of two */
+	unsigned int count;
+} IntMap;
+
 enum { BAR_TOP, BAR_BOTTOM, BAR_OFF };
 enum { BAR_LEFT, BAR_RIGHT };
 
@@ -146,6 +279,7 @@ typedef struct {
 	int pos, lastpos;
 	int align;
 	bool autohide;
+	bool stats;
 	unsigned short int h;
 	unsigned short int y;
 	char text[512];
@@ -158,11 +292,113 @@ typedef struct {
 	unsigned short int id;
 } Fifo;
 
+/* maximal size of a request frame on the command socket */
+#define CMDSOCK_FRAME_MAX (1 << 20)
+/* requests are left unread while this much of the responses is pending */
+#define CMDSOCK_QUEUE_MAX (1 << 20)
+
+enum {
+	EVT_FOCUS   = 1 << 0,
+	EVT_TITLE   = 1 << 1,
+	EVT_URGENT  = 1 << 2,
+	EVT_TAG     = 1 << 3,
+	EVT_CREATE  = 1 << 4,
+	EVT_DESTROY = 1 << 5,
+	EVT_USER    = 1 << 6,
+	EVT_ALL     = (1 << 7) - 1,
+};
+
+#define EVT_RING_SIZE 16384
+
 typedef struct {
-	char *data;
-	size_t len;
-	size_t size;
-} Register;
+	char data[EVT_RING_SIZE];
+	size_t start, len;
+} Ring;
+
+typedef struct {
+	unsigned int filter;     /* mask of subscribed event types */
+	unsigned long dropped;   /* events lost since the last drop notice */
+	Ring ring;               /* events not yet handed to the consumer */
+} EvtSub;
+
+/* response frames with this bit set in the length carry events */
+#define CMDSOCK_EVENT_FRAME 0x80000000u
+
+/* A session started with -a runs dvtm on a pseudo terminal owned by a
+ * server process, which mirrors the screen in a Vt. Attaching clients get
+ * a snapshot of the mirror followed by the output as it is produced. */
+typedef struct SessionConn SessionConn;
+struct SessionConn {
+	int fd;
+	Register in;      /* partially received frames */
+	Register out;     /* screen updates not yet written */
+	SessionConn *next;
+};
+
+typedef struct {
+	int fd;           /* listening socket */
+	const char *file;
+	int pty;          /* master side of the terminal dvtm runs on */
+	Register input;   /* keyboard input not yet written to the terminal */
+	pid_t pid;
+	Vt *screen;       /* mirror of that terminal */
+	SessionConn *conns;
+} Session;
+
+/* frames sent by session clients: a type, the payload length as 32 bit
+ * big endian number and the payload */
+enum {
+	SESSION_INPUT = 'i',   /* keyboard input */
+	SESSION_WINSIZE = 'w', /* rows and columns as 16 bit big endian numbers */
+};
+
+#define SESSION_FRAME_MAX (1 << 16)
+/* a client lagging further behind is sent a fresh snapshot instead */
+#define SESSION_QUEUE_MAX (256 << 10)
+
+/* every command source, the FIFO and each connection, batches on its own */
+typedef struct {
+	int depth;        /* nesting level of begin/commit pairs */
+	bool arrange;     /* arrange() was requested within the batch */
+	bool draw;        /* draw_all() was requested within the batch */
+} Batch;
+
+typedef struct CmdConn CmdConn;
+struct CmdConn {
+	int fd;
+	bool eof;         /* peer shut down its sending side */
+	Batch batch;      /* of the requests, may stay open across reads */
+	EvtSub *evt;      /* event subscription, if any */
+	Register in;      /* partially received request frames */
+	Register out;     /* response frames not yet written */
+	size_t frame;     /* offset of the response frame being built */
+	int fdin;         /* descriptor received from the client, or -1 */
+	int fdout;        /* descriptor sent along with the frame at offset fdout_pos, or -1 */
+	size_t fdout_pos;
+	CmdConn *next;
+};
+
+typedef struct {
+	int fd;
+	const char *file;
+	CmdConn *conns;
+	CmdConn *current; /* connection whose request is being executed */
+} CmdSocket;
+
+#define TRACE_BUCKETS 32
+
+typedef struct {
+	unsigned long count;
+	uint64_t max_ns;
+	unsigned long buckets[TRACE_BUCKETS]; /* bucket i: latencies below 2^i µs */
+} Histogram;
+
+typedef struct {
+	bool enabled;
+	bool used;
+	Histogram read;   /* key press to the next read from the pty */
+	Histogram screen; /* key press to doupdate() of the echo */
+} Trace;
 
 typedef struct {
 	char *name;
@@ -189,6 +425,12 @@ static void copymode(const char *args[]);
 static void copybuf(const char *args[]);
 static void sendtext(const char *args[]);
 static void capture(const char *args[]);
+static void region(const char *args[]);
+static void tap(const char *args[]);
+static void stats(const char *args[]);
+static void tracelatency(const char *args[]);
+static void batchbegin(const char *args[]);
+static void batchcommit(const char *args[]);
 static void focusn(const char *args[]);
 static void focusid(const char *args[]);
 static void focusnext(const char *args[]);
@@ -208,7 +450,7 @@ static void paste(const char *args[]);
 static void quit(const char *args[]);
 static void redraw(const char *args[]);
 static void scrollback(const char *args[]);
-static void send(const char *args[]);
+static void sendkeys(const char *args[]);
 static void setlayout(const char *args[]);
 static void togglemaximize(const char *args[]);
 static void incnmaster(const char *args[]);
@@ -233,12 +475,29 @@ static void view(const char *args[]);
 static void zoom(const char *args[]);
 static void setcwd(const char *args[]);
 static void senduserevt(const char *args[]);
-static void sendevtfmt(const char *fmt, ... );
+static void sendevtfmt(unsigned int type, const char *fmt, ... );
+static void subscribe(const char *args[]);
 static void docmd(const char *args[]);
 static void doexec(const char *args[]);
 static void doret(const char *msg, size_t len);
+static bool register_append(Register *r, const char *data, size_t len);
+static void batch_end(void);
+static void transfer_queue(Client *c, const char *reg, size_t size, bool paste);
+static void tap_close(Client *c);
+static bool tap_write(Tap *tap);
+static void tap_free(Tap *tap);
+static void register_consume(Register *r, size_t len);
+static char *rope_space(Rope *r, size_t *avail);
+static void rope_commit(Rope *r, size_t len);
+static void rope_free(Rope *r);
+static void cmdindex_build(void);
+static void cmdconn_close(CmdConn *conn);
+static bool cmdconn_flush(CmdConn *conn);
+static bool cmdconn_ready(CmdConn *conn);
+static size_t trace_format(char *buf, size_t size);
 static void setstatus(const char *args[]);
 static void setminimized(const char *args[]);
+static void split(const char *args[]);
 
 /* commands for use by mouse bindings */
 static void mouse_focus(const char *args[]);
@@ -249,12 +508,15 @@ static void mouse_zoom(const char *args[]);
 /* functions and variables available to layouts via config.h */
 static void attachafter(Client *c, Client *a);
 static Client* nextvisible(Client *c);
+static void splittree(Rect *r, unsigned int n, unsigned int nmaster, float mfact, Rect area);
 
 static void focus(Client *c);
 static void resize(Client *c, int x, int y, int w, int h);
+static void vacate(Client *c);
 extern Screen screen;
 static unsigned int waw, wah, wax, way;
 static Client *clients = NULL;
+static Tap *taps;   /* closed, written until their queue is empty */
 static char *title;
 static bool show_tagnamebycwd = false;
 
@@ -264,6 +526,12 @@ static int usrkeybn;
 static KeyBinding *modkeyb = NULL;
 static int modkeybn;
 
+static KeyIndex bindings_index, modkeyb_index, usrkeyb_index;
+static CmdIndex commands_index;
+static IntMap client_ids;   /* window id to client */
+static IntMap client_pids;  /* pid of application and overlay to client */
+static volatile sig_atomic_t child_died;
+
 #include "config.h"
 
 #define CWD_MAX		256
@@ -280,6 +548,9 @@ typedef struct {
 	char *cwd[LENGTH(tags) + 1];
 	char *name[LENGTH(tags) + 1];
 	bool msticky[LENGTH(tags) + 1];
+	LayoutCache cache[LENGTH(tags) + 1];
+	Split *split[LENGTH(tags) + 1];
+	char splitdir[LENGTH(tags) + 1]; /* of the next split, 'h', 'v' or automatic */
 } Pertag;
 
 /* global variables */
@@ -303,10 +574,21 @@ static StatusBar bar = { .fd = -1,
 		       };
 static Fifo cmdfifo = { .fd = -1 };
 static Fifo evtfifo = { .fd = -1 };
+static EvtSub evtfifo_sub = { .filter = EVT_ALL };
 static Fifo cpyfifo = { .fd = -1 };
 static Fifo retfifo = { .fd = -1 };
+static Trace tracer;
+static CmdSocket cmdsock = { .fd = -1 };
+static Batch *batch;   /* of the command source being executed, if any */
+static Batch fifobatch;
+static bool arrange_full; /* let the next arrange() repaint everything */
+static bool arrange_damaged; /* a window was removed from the layout */
 static const char *shell;
-static Register copyreg;
+/* history of the default register 0-9 followed by the named ones a-z */
+#define REGISTER_HISTORY 10
+static Rope copyregs[REGISTER_HISTORY + 26];
+static Transfer transfer;
+static Transfer *transfers; /* waiting for the current one to complete */
 static volatile sig_atomic_t running = true;
 static bool runinall = false;
 /* make sense only in layouts which has master window (tile, bstack) */
@@ -330,7 +612,7 @@ error(const char *errstr, ...) {
 }
 
 static bool
-isarrange(void (*func)()) {
+isarrange(void (*func)(Rect*, unsigned int, unsigned int, float, Rect)) {
 	return func == layout->arrange;
 }
 
@@ -341,7 +623,7 @@ isvisible(Client *c) {
 
 static bool
 is_content_visible(Client *c) {
-	if (!c)
+	if (!c || !c->window)
 		return false;
 	if (isarrange(fullscreen))
 		return sel == c;
@@ -373,6 +655,8 @@ static bool ismastersticky(Client *c) {
 
 static void
 updatebarpos(void) {
+	unsigned int y = way, h = wah;
+
 	bar.y = 0;
 	wax = 0;
 	way = 0;
@@ -385,6 +669,8 @@ updatebarpos(void) {
 		wah -= bar.h;
 		bar.y = wah;
 	}
+	if (way != y || wah != h)
+		arrange_full = true;
 }
 
 static void
@@ -401,6 +687,13 @@ showbar(void) {
 		bar.pos = pertag.barpos[pertag.curtag] = bar.lastpos;
 }
 
+static uint64_t
+timestamp_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 static void
 drawbar(void) {
 	char buf[128];
@@ -442,6 +735,12 @@ drawbar(void) {
 	addstr(layout->symbol);
 	attrset(TAG_NORMAL);
 
+	if (bar.stats && sel) {
+		ClientStats *s = &sel->stats;
+		printw("[%d %lluK %.1fms]", sel->id, vt_stats_get(sel->app)->bytes >> 10,
+		       s->latency_count ? s->latency_ns / 1e6 / s->latency_count : 0.0);
+	}
+
 	getyx(stdscr, y, x);
 	(void)y;
 	int maxwidth = screen.w - x - 2;
@@ -494,7 +793,7 @@ draw_border(Client *c) {
 	char t = '\0';
 
 
-	if (!show_border())
+	if (!show_border() || !c->window)
 		return;
 	if (sel != c && c->urgent)
 		attrs = URGENT_ATTR;
@@ -531,13 +830,18 @@ draw_border(Client *c) {
 
 static void
 draw_content(Client *c) {
+	if (!c->window)
+		return;
+	uint64_t start = timestamp_ns();
 	vt_draw(c->term, c->window, c->has_title_line, 0);
+	c->stats.draw_ns += timestamp_ns() - start;
 }
 
 static void
 draw(Client *c) {
 	if (is_content_visible(c)) {
-		redrawwin(c->window);
+		/* curses only sends what actually differs from the screen */
+		touchwin(c->window);
 		draw_content(c);
 	}
 	if (!isarrange(fullscreen) || c == sel)
@@ -547,6 +851,11 @@ draw(Client *c) {
 
 static void
 draw_all(void) {
+	if (batch && batch->depth) {
+		batch->draw = true;
+		return;
+	}
+
 	if (!nextvisible(clients)) {
 		sel = NULL;
 		curs_set(0);
@@ -570,16 +879,333 @@ draw_all(void) {
 		draw(sel);
 }
 
+/* returns the geometry of n tiled windows of the current tag, it is only
+ * recomputed if the layout or one of its parameters changed */
+static Rect *
+layout_rects(unsigned int n, Rect area) {
+	LayoutCache *lc = &pertag.cache[pertag.curtag];
+
+	if (lc->rects && lc->layout == layout && !isarrange(splittree) && lc->n == n && lc->nmaster == (unsigned int)getnmaster() &&
+	    lc->mfact == getmfact() && !memcmp(&lc->area, &area, sizeof area))
+		return lc->rects;
+	if (n > lc->size) {
+		Rect *rects = realloc(lc->rects, sizeof(Rect) * n);
+		if (!rects)
+			return NULL;
+		lc->rects = rects;
+		lc->size = n;
+	}
+	if (!lc->rects)
+		return NULL;
+	layout->arrange(lc->rects, n, getnmaster(), getmfact(), area);
+	lc->layout = layout;
+	lc->n = n;
+	lc->nmaster = getnmaster();
+	lc->mfact = getmfact();
+	lc->area = area;
+	return lc->rects;
+}
+
+static bool
+separator_at(Rect *r, unsigned int n, Rect area, int x, int y) {
+	for (unsigned int i = 0; i < n; i++) {
+		if (r[i].x > area.x && r[i].x - 1 == x && y >= r[i].y && y < r[i].y + r[i].h)
+			return true;
+	}
+	return false;
+}
+
+/* joins the separator at x with the title lines of the windows starting at y */
+static void
+draw_junction(Rect *r, unsigned int n, Rect area, int x, int y) {
+	bool up = separator_at(r, n, area, x, y - 1), left = false, right = false;
+
+	for (unsigned int i = 0; i < n; i++) {
+		if (r[i].y != y)
+			continue;
+		if (r[i].x + r[i].w == x)
+			left = true;
+		if (r[i].x - 1 == x)
+			right = true;
+	}
+	if (left && right)
+		mvaddch(y, x, up ? ACS_PLUS : ACS_TTEE);
+	else if (right)
+		mvaddch(y, x, up ? ACS_LTEE : ACS_ULCORNER);
+	else if (left)
+		mvaddch(y, x, up ? ACS_RTEE : ACS_URCORNER);
+}
+
+/* every window not touching the left edge of the area is preceded by a
+ * vertical separator */
+static void
+draw_separators(Rect *r, unsigned int n, Rect area) {
+	for (unsigned int i = 0; i < n; i++) {
+		if (r[i].x > area.x)
+			mvvline(r[i].y, r[i].x - 1, ACS_VLINE, r[i].h);
+	}
+	for (unsigned int i = 0; i < n; i++) {
+		if (r[i].x > area.x)
+			draw_junction(r, n, area, r[i].x - 1, r[i].y);
+		if (separator_at(r, n, area, r[i].x + r[i].w, r[i].y))
+			draw_junction(r, n, area, r[i].x + r[i].w, r[i].y);
+	}
+}
+
+static Split *
+split_new(Client *c) {
+	Split *s = calloc(1, sizeof *s);
+	if (s) {
+		s->client = c;
+		s->ratio = 0.5;
+		s->dirty = true;
+	}
+	return s;
+}
+
+static void
+split_free(Split *s) {
+	if (!s)
+		return;
+	split_free(s->child[0]);
+	split_free(s->child[1]);
+	free(s);
+}
+
+/* marks the path from the root down to s for split_place() */
+static void
+split_touch(Split *s) {
+	for (; s; s = s->parent)
+		s->dirty = true;
+}
+
+/* puts b where a is in the tree */
+static void
+split_replace(Split **root, Split *a, Split *b) {
+	b->parent = a->parent;
+	if (!a->parent)
+		*root = b;
+	else
+		a->parent->child[a->parent->child[1] == a] = b;
+	split_touch(b);
+}
+
+/* the sibling of the leaf takes over the area of their parent */
+static void
+split_remove(Split **root, Split *leaf) {
+	Split *p = leaf->parent;
+	if (p) {
+		split_replace(root, p, p->child[p->child[0] == leaf]);
+		free(p);
+	} else {
+		*root = NULL;
+	}
+	free(leaf);
+}
+
+/* splits the area of the leaf at between it and a new leaf for c */
+static Split *
+split_insert(Split **root, Split *at, Client *c, char dir) {
+	Split *leaf = split_new(c), *node;
+	if (!leaf || !at) {
+		if (leaf)
+			*root = leaf;
+		return leaf;
+	}
+	if (!(node = split_new(NULL))) {
+		free(leaf);
+		return NULL;
+	}
+	split_replace(root, at, node);
+	node->child[0] = at;
+	node->child[1] = leaf;
+	at->parent = leaf->parent = node;
+	/* automatically along the longer side, cells are about twice as high as wide */
+	node->vertical = dir ? dir == 'h' : at->rect.w > 2 * at->rect.h;
+	return leaf;
+}
+
+static Split *
+split_find(Split *s, Client *c) {
+	if (!s || s->client == c)
+		return s;
+	Split *leaf = split_find(s->child[0], c);
+	return leaf ? leaf : split_find(s->child[1], c);
+}
+
+static Split *
+split_last(Split *s) {
+	while (s && s->child[1])
+		s = s->child[1];
+	return s;
+}
+
+/* removes the leaves of windows which are no longer tiled on the current
+ * tag in one walk, removing a leaf frees its parent but not its sibling */
+static void
+split_prune(Split **root, Split *s) {
+	if (!s)
+		return;
+	if (!s->child[0]) {
+		if (!isvisible(s->client) || s->client->minimized)
+			split_remove(root, s);
+		return;
+	}
+	Split *a = s->child[0], *b = s->child[1];
+	split_prune(root, a);
+	split_prune(root, b);
+}
+
+static void
+split_link(Split *s) {
+	if (!s)
+		return;
+	if (s->client)
+		s->client->leaf = s;
+	split_link(s->child[0]);
+	split_link(s->child[1]);
+}
+
+static void
+split_detach(Client *c) {
+	for (unsigned int i = 0; i < LENGTH(pertag.split); i++) {
+		Split *leaf = split_find(pertag.split[i], c);
+		if (leaf)
+			split_remove(&pertag.split[i], leaf);
+	}
+	c->leaf = NULL;
+}
+
+/* brings the tree in line with the tiled windows, new ones split the area
+ * of the focused window */
+static void
+split_sync(Split **root) {
+	Split *at;
+
+	split_prune(root, *root);
+	for (Client *c = clients; c; c = c->next)
+		c->leaf = NULL;
+	split_link(*root);
+	for (Client *c = nextvisible(clients); c; c = nextvisible(c->next)) {
+		if (c->leaf || c->minimized)
+			continue;
+		if (sel && sel->leaf)
+			at = sel->leaf;
+		else if (lastsel && lastsel->leaf)
+			at = lastsel->leaf;
+		else
+			at = split_last(*root);
+		c->leaf = split_insert(root, at, c, pertag.splitdir[pertag.curtag]);
+	}
+}
+
+/* subtrees whose area and ratios did not change keep their geometry */
+static void
+split_place(Split *s, Rect r) {
+	if (!s->dirty && !memcmp(&s->rect, &r, sizeof r))
+		return;
+	s->rect = r;
+	s->dirty = false;
+	if (!s->child[0])
+		return;
+	Rect a = r, b = r;
+	if (s->vertical) {
+		a.w = MIN(MAX((int)((r.w - 1) * s->ratio), 1), MAX(r.w - 2, 1));
+		b.x = r.x + a.w + 1;
+		b.w = r.w - a.w - 1;
+	} else {
+		a.h = MIN(MAX((int)(r.h * s->ratio), 1), MAX(r.h - 1, 1));
+		b.y = r.y + a.h;
+		b.h = r.h - a.h;
+	}
+	split_place(s->child[0], a);
+	split_place(s->child[1], b);
+}
+
+static void
+splittree(Rect *r, unsigned int n, unsigned int nmaster, float mfact, Rect area) {
+	Split **root = &pertag.split[pertag.curtag];
+	unsigned int i = 0;
+
+	split_sync(root);
+	if (*root)
+		split_place(*root, area);
+	for (Client *c = nextvisible(clients); c && i < n; c = nextvisible(c->next)) {
+		if (!c->minimized)
+			r[i++] = c->leaf ? c->leaf->rect : area;
+	}
+}
+
+/* the window next to c, found by walking up to the closest split in the
+ * given direction and down again on its other side, side 1 is right/down */
+static Client *
+split_neighbour(Client *c, bool vertical, int side) {
+	Split *s = c ? c->leaf : NULL;
+
+	while (s && s->parent && (s->parent->vertical != vertical || s->parent->child[side] == s))
+		s = s->parent;
+	if (!s || !s->parent)
+		return NULL;
+	for (s = s->parent->child[side]; s->child[0]; ) {
+		if (s->vertical == vertical)
+			s = s->child[!side];
+		else if (s->vertical)
+			s = s->child[c->x >= s->child[1]->rect.x];
+		else
+			s = s->child[c->y >= s->child[1]->rect.y];
+	}
+	return s->client;
+}
+
+/* blanks the area of stdscr a window covers and the separators next to it */
+static void
+vacate(Client *c) {
+	int x = MAX(c->x - 1, 0), w = MIN(c->x + c->w + 1, screen.w) - x;
+
+	if (!c->window || w <= 0)
+		return;
+	attrset(NORMAL_ATTR);
+	for (int y = c->y; y < c->y + c->h && y < screen.h; y++)
+		mvhline(y, x, ' ', w);
+}
+
+static void
+place(Client *c, int x, int y, int w, int h) {
+	if (!arrange_full && c->arranged && (c->x != x || c->y != y || c->w != w || c->h != h))
+		vacate(c);
+	resize(c, x, y, w, h);
+}
+
+static void
+draw_arranged(Client *c) {
+	if (c->moved) {
+		draw(c);
+	} else {
+		if (!isarrange(fullscreen))
+			draw_border(c);
+		wnoutrefresh(c->window);
+	}
+	c->moved = false;
+}
+
+/* only the windows which were shown or changed their geometry are redrawn,
+ * together with the separators, the screen is repainted as a whole if the
+ * area available to the layout changed */
 static void
 arrange(void) {
 	unsigned int m = 0, n = 0, dh = 0;
+	bool full, damaged = arrange_damaged;
+	Rect *r;
+
+	if (batch && batch->depth) {
+		batch->arrange = true;
+		return;
+	}
 	for (Client *c = nextvisible(clients); c; c = nextvisible(c->next)) {
 		c->order = ++n;
 		if (c->minimized)
 			m++;
 	}
-	erase();
-	attrset(NORMAL_ATTR);
 	if (bar.fd == -1 && bar.autohide) {
 		if ((!clients || !clients->next) && n == 1)
 			hidebar();
@@ -587,6 +1213,16 @@ arrange(void) {
 			showbar();
 		updatebarpos();
 	}
+	if ((full = arrange_full))
+		erase();
+	for (Client *c = clients; c; c = c->next) {
+		if (c->arranged && !isvisible(c)) {
+			if (!full)
+				vacate(c);
+			damaged = true;
+		}
+	}
+	attrset(NORMAL_ATTR);
 	if (m && !isarrange(fullscreen)) {
 		if (min_align == MIN_ALIGN_VERT)
 			dh = m;
@@ -594,26 +1230,78 @@ arrange(void) {
 			dh = 1;
 	}
 	wah -= dh;
-	layout->arrange();
-	if (m && !isarrange(fullscreen)) {
+	/* minimized windows are only tiled by the fullscreen layout */
+	if (isarrange(fullscreen))
+		m = 0;
+	if (m) {
 		unsigned int i = 0, nw = waw / m, nx = wax;
 		for (Client *c = nextvisible(clients); c; c = nextvisible(c->next)) {
 			if (c->minimized) {
 				if (min_align == MIN_ALIGN_VERT) {
-					resize(c, nx, way+wah+i, waw, 1);
+					place(c, nx, way+wah+i, waw, 1);
 					i++;
 				} else {
-					resize(c, nx, way+wah, ++i == m ? waw - nx : nw, 1);
+					place(c, nx, way+wah, ++i == m ? waw - nx : nw, 1);
 					nx += nw;
 				}
 			}
 		}
-		wah += dh;
 	}
+	Rect area = { wax, way, waw, wah };
+	if ((r = layout_rects(n - m, area))) {
+		unsigned int i = 0;
+		for (Client *c = nextvisible(clients); c; c = nextvisible(c->next)) {
+			if (m && c->minimized)
+				continue;
+			place(c, r[i].x, r[i].y, r[i].w, r[i].h);
+			i++;
+		}
+	}
+	for (Client *c = nextvisible(clients); c; c = nextvisible(c->next)) {
+		if (!c->arranged || full)
+			c->moved = true;
+		if (c->moved)
+			damaged = true;
+	}
+	if (r && damaged)
+		draw_separators(r, n - m, area);
+	wah += dh;
+	/* windows which kept their place are copied again over the lines
+	 * of stdscr which are about to be refreshed */
+	for (Client *c = nextvisible(clients); c && damaged && !full; c = nextvisible(c->next)) {
+		for (int y = c->y; !c->moved && y < c->y + c->h; y++) {
+			if (is_linetouched(stdscr, y)) {
+				touchwin(c->window);
+				break;
+			}
+		}
+	}
+	for (Client *c = clients; c; c = c->next) {
+		c->arranged = isvisible(c);
+		/* hidden clients keep their terminal at the last size but
+		 * give up the curses window until their tag is viewed again */
+		if (!c->arranged && c->window) {
+			delwin(c->window);
+			c->window = NULL;
+			c->moved = false;
+		}
+	}
+	arrange_full = arrange_damaged = false;
 	focus(NULL);
 	wnoutrefresh(stdscr);
 	drawbar();
-	draw_all();
+	if (!sel) {
+		draw_all();
+		return;
+	}
+	if (!isarrange(fullscreen)) {
+		for (Client *c = nextvisible(clients); c; c = nextvisible(c->next)) {
+			if (c != sel)
+				draw_arranged(c);
+		}
+	}
+	/* the selected window comes last to place the cursor */
+	draw_arranged(sel);
 }
 
 static Client *
@@ -728,9 +1416,10 @@ focus(Client *c) {
 		return;
 	lastsel = sel;
 	sel = c;
+	sendevtfmt(EVT_FOCUS, "focus %d\n", c ? c->id : 0);
 	if (lastsel) {
 		lastsel->urgent = false;
-		if (!isarrange(fullscreen)) {
+		if (!isarrange(fullscreen) && lastsel->window) {
 			draw_border(lastsel);
 			wnoutrefresh(lastsel->window);
 		}
@@ -743,7 +1432,7 @@ focus(Client *c) {
 		c->urgent = false;
 		if (isarrange(fullscreen)) {
 			draw(c);
-		} else {
+		} else if (c->window) {
 			draw_border(c);
 			wnoutrefresh(c->window);
 		}
@@ -781,12 +1470,14 @@ term_title_handler(Vt *term, const char *title) {
 	if (!isarrange(fullscreen))
 		draw_border(c);
 	applycolorrules(c);
+	sendevtfmt(EVT_TITLE, "title %d %s\n", c->id, c->title);
 }
 
 static void
 term_urgent_handler(Vt *term) {
 	Client *c = (Client *)vt_data_get(term);
 	c->urgent = true;
+	sendevtfmt(EVT_URGENT, "urgent %d\n", c->id);
 	printf("\a");
 	fflush(stdout);
 	drawbar();
@@ -804,6 +1495,7 @@ move_client(Client *c, int x, int y) {
 	} else {
 		c->x = x;
 		c->y = y;
+		c->moved = true;
 	}
 }
 
@@ -821,15 +1513,49 @@ resize_client(Client *c, int w, int h) {
 		}
 	}
 	if (resize_window || c->has_title_line != has_title_line) {
+		c->moved = true;
 		c->has_title_line = has_title_line;
 		vt_resize(c->app, h - has_title_line, w);
 		if (c->overlay)
 			vt_resize(c->overlay, h - has_title_line, w);
+		/* restart the delay, applications only see the final size */
+		c->winsize_ns = timestamp_ns() + RESIZE_DELAY * 1000000ULL;
 	}
 }
 
+/* announces changed sizes whose delay expired, returns the time of the
+ * next pending announcement or 0 */
+static uint64_t
+winsize_sync(uint64_t now) {
+	uint64_t next = 0;
+
+	for (Client *c = clients; c; c = c->next) {
+		if (!c->winsize_ns)
+			continue;
+		if (c->winsize_ns <= now) {
+			vt_winsize_sync(c->app);
+			if (c->overlay)
+				vt_winsize_sync(c->overlay);
+			c->winsize_ns = 0;
+		} else if (!next || c->winsize_ns < next) {
+			next = c->winsize_ns;
+		}
+	}
+	return next;
+}
+
 static void
 resize(Client *c, int x, int y, int w, int h) {
+	if (!c->window) {
+		if (!(c->window = newwin(h, w, y, x))) {
+			eprint("error creating window, w: %d h: %d\n", w, h);
+			return;
+		}
+		c->x = x;
+		c->y = y;
+		c->moved = true;
+		vt_dirty(c->term);
+	}
 	resize_client(c, w, h);
 	move_client(c, x, y);
 }
@@ -851,35 +1577,8 @@ get_client_by_coord(unsigned int x, unsigned int y) {
 
 static void
 sigchld_handler(int sig) {
-	int errsv = errno;
-	int status;
-	pid_t pid;
-
-	while ((pid = waitpid(-1, &status, WNOHANG)) != 0) {
-		if (pid == -1) {
-			if (errno == ECHILD) {
-				/* no more child processes */
-				break;
-			}
-			eprint("waitpid: %s\n", strerror(errno));
-			break;
-		}
-
-		debug("child with pid %d died\n", pid);
-
-		for (Client *c = clients; c; c = c->next) {
-			if (c->pid == pid) {
-				c->died = true;
-				break;
-			}
-			if (c->overlay && vt_pid_get(c->overlay) == pid) {
-				c->overlay_died = true;
-				break;
-			}
-		}
-	}
-
-	errno = errsv;
+	/* children are reaped from the main loop by reap_children() */
+	child_died = true;
 }
 
 static void
@@ -909,31 +1608,154 @@ resize_screen(void) {
 	wresize(stdscr, screen.h, screen.w);
 	updatebarpos();
 	clear();
+	arrange_full = true;
 	arrange();
 }
 
-static KeyBinding*
-keybindmatch(KeyBinding *keyb, unsigned int keybn, KeyCombo keys, unsigned int keycount) {
-	for (unsigned int b = 0; b < keybn; b++) {
-		for (unsigned int k = 0; k < keycount; k++) {
-			if (keys[k] != keyb[b].keys[k])
-				break;
-			if (k == keycount - 1)
-				return &keyb[b];
-		}
+/* FNV-1a */
+static uint32_t
+hash(const void *data, size_t len) {
+	const unsigned char *p = data;
+	uint32_t h = 2166136261u;
+	while (len--) {
+		h ^= *p++;
+		h *= 16777619;
 	}
-	return NULL;
+	return h;
+}
+
+static unsigned int
+hash_size(unsigned int n) {
+	unsigned int size = 8;
+	while (size < 2 * n)
+		size *= 2;
+	return size;
+}
+
+static unsigned int
+intmap_slot(IntMap *map, int key) {
+	unsigned int i = ((uint32_t)key * 2654435769u) & (map->size - 1);
+	while (map->entries[i].value && map->entries[i].key != key)
+		i = (i + 1) & (map->size - 1);
+	return i;
+}
+
+static void*
+intmap_get(IntMap *map, int key) {
+	return map->size ? map->entries[intmap_slot(map, key)].value : NULL;
+}
+
+static bool
+intmap_put(IntMap *map, int key, void *value) {
+	if (2 * (map->count + 1) > map->size) {
+		IntMap new = { .size = hash_size(map->count + 1) };
+		if (!(new.entries = calloc(new.size, sizeof(*new.entries))))
+			return false;
+		for (unsigned int i = 0; i < map->size; i++) {
+			if (map->entries[i].value)
+				new.entries[intmap_slot(&new, map->entries[i].key)] = map->entries[i];
+		}
+		new.count = map->count;
+		free(map->entries);
+		*map = new;
+	}
+	IntMapEntry *e = &map->entries[intmap_slot(map, key)];
+	if (!e->value)
+		map->count++;
+	e->key = key;
+	e->value = value;
+	return true;
+}
+
+/* removes the entry if it still maps to the given value */
+static void
+intmap_del(IntMap *map, int key, void *value) {
+	if (!map->size)
+		return;
+	unsigned int i = intmap_slot(map, key), j = i;
+	if (map->entries[i].value != value)
+		return;
+	map->entries[i].value = NULL;
+	map->count--;
+	/* move displaced entries back to close the gap in the probe sequence */
+	for (;;) {
+		j = (j + 1) & (map->size - 1);
+		if (!map->entries[j].value)
+			return;
+		unsigned int home = ((uint32_t)map->entries[j].key * 2654435769u) & (map->size - 1);
+		if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+			map->entries[i] = map->entries[j];
+			map->entries[j].value = NULL;
+			i = j;
+		}
+	}
+}
+
+static void
+intmap_free(IntMap *map) {
+	free(map->entries);
+	memset(map, 0, sizeof(*map));
+}
+
+static KeyIndexSlot*
+keyindex_slot(KeyIndex *idx, const unsigned int *keys, unsigned int keycount) {
+	unsigned int i = hash(keys, keycount * sizeof(*keys)) & (idx->size - 1);
+	for (;; i = (i + 1) & (idx->size - 1)) {
+		KeyIndexSlot *slot = &idx->slots[i];
+		if (slot->binding == -1)
+			return slot;
+		if (slot->count == keycount && !memcmp(idx->bindings[slot->binding].keys,
+		                                       keys, keycount * sizeof(*keys)))
+			return slot;
+	}
+}
+
+static void
+keyindex_free(KeyIndex *idx) {
+	free(idx->slots);
+	idx->slots = NULL;
+}
+
+static void
+keyindex_build(KeyIndex *idx, KeyBinding *keyb, unsigned int keybn) {
+	keyindex_free(idx);
+	idx->bindings = keyb;
+	idx->n = keybn;
+	idx->size = hash_size(keybn * MAX_KEYS);
+	if (!(idx->slots = malloc(idx->size * sizeof(*idx->slots))))
+		error("fail on key index malloc\n");
+	for (unsigned int i = 0; i < idx->size; i++)
+		idx->slots[i].binding = -1;
+	for (unsigned int b = 0; b < keybn; b++) {
+		for (unsigned int k = 1; k <= MAX_KEYS; k++) {
+			KeyIndexSlot *slot = keyindex_slot(idx, keyb[b].keys, k);
+			if (slot->binding == -1) {
+				slot->binding = b;
+				slot->count = k;
+			}
+		}
+	}
+}
+
+static KeyBinding*
+keybindmatch(KeyIndex *idx, KeyBinding *keyb, unsigned int keybn, KeyCombo keys, unsigned int keycount) {
+	if (!keybn || !keycount || keycount > MAX_KEYS)
+		return NULL;
+	if (!idx->slots || idx->bindings != keyb || idx->n != keybn)
+		keyindex_build(idx, keyb, keybn);
+	KeyIndexSlot *slot = keyindex_slot(idx, keys, keycount);
+	return slot->binding == -1 ? NULL : &keyb[slot->binding];
 }
 
 static KeyBinding*
 keybinding(KeyCombo keys, unsigned int keycount) {
 	KeyBinding *keyb;
 
-	keyb = keybindmatch(bindings, LENGTH(bindings), keys, keycount);
+	keyb = keybindmatch(&bindings_index, bindings, LENGTH(bindings), keys, keycount);
 	if (!keyb && modkeyb)
-		keyb = keybindmatch(modkeyb, modkeybn, keys, keycount);
+		keyb = keybindmatch(&modkeyb_index, modkeyb, modkeybn, keys, keycount);
 	if (!keyb)
-		keyb = keybindmatch(usrkeyb, usrkeybn, keys, keycount);
+		keyb = keybindmatch(&usrkeyb_index, usrkeyb, usrkeybn, keys, keycount);
 	return keyb;
 }
 
@@ -967,6 +1789,7 @@ tag(const char *args[]) {
 	if (!sel)
 		return;
 	sel->tags = bitoftag(args[0]) & TAGMASK;
+	sendevtfmt(EVT_TAG, "tags %d %u\n", sel->id, sel->tags);
 	tagschanged();
 }
 
@@ -975,25 +1798,24 @@ tagid(const char *args[]) {
 	if (!args[0] || !args[1])
 		return;
 
-	const int win_id = atoi(args[0]);
-	for (Client *c = clients; c; c = c->next) {
-		if (c->id == win_id) {
-			unsigned int ntags = c->tags;
-			for (unsigned int i = 1; i < MAX_ARGS && args[i]; i++) {
-				if (args[i][0] == '+')
-					ntags |= bitoftag(args[i]+1);
-				else if (args[i][0] == '-')
-					ntags &= ~bitoftag(args[i]+1);
-				else
-					ntags = bitoftag(args[i]);
-			}
-			ntags &= TAGMASK;
-			if (ntags) {
-				c->tags = ntags;
-				tagschanged();
-			}
-			return;
-		}
+	Client *c = intmap_get(&client_ids, atoi(args[0]));
+	if (!c)
+		return;
+
+	unsigned int ntags = c->tags;
+	for (unsigned int i = 1; i < MAX_ARGS && args[i]; i++) {
+		if (args[i][0] == '+')
+			ntags |= bitoftag(args[i]+1);
+		else if (args[i][0] == '-')
+			ntags &= ~bitoftag(args[i]+1);
+		else
+			ntags = bitoftag(args[i]);
+	}
+	ntags &= TAGMASK;
+	if (ntags) {
+		c->tags = ntags;
+		sendevtfmt(EVT_TAG, "tags %d %u\n", c->id, c->tags);
+		tagschanged();
 	}
 }
 
@@ -1047,6 +1869,7 @@ toggletag(const char *args[]) {
 	unsigned int newtags = sel->tags ^ (bitoftag(args[0]) & TAGMASK);
 	if (newtags) {
 		sel->tags = newtags;
+		sendevtfmt(EVT_TAG, "tags %d %u\n", sel->id, sel->tags);
 		tagschanged();
 	}
 }
@@ -1060,7 +1883,7 @@ setpertag(void) {
 	}
 	bar.lastpos = pertag.barlastpos[pertag.curtag];
 	runinall = pertag.runinall[pertag.curtag];
-	sendevtfmt("curtag %d\n", pertag.curtag);
+	sendevtfmt(EVT_TAG, "curtag %d\n", pertag.curtag);
 }
 
 static void
@@ -1137,6 +1960,10 @@ keypress(int code) {
 	for (Client *c = pertag.runinall[pertag.curtag] ? nextvisible(clients) : sel; c; c = nextvisible(c->next)) {
 		if (is_content_visible(c)) {
 			c->urgent = false;
+			if (!c->stats.input_ns)
+				c->stats.input_ns = timestamp_ns();
+			if (tracer.enabled && !c->stats.trace_key_ns)
+				c->stats.trace_key_ns = timestamp_ns();
 			if (code == '\e')
 				vt_write(c->term, buf, len);
 			else
@@ -1217,6 +2044,7 @@ setup(void) {
 	mouse_setup();
 	raw();
 	vt_init();
+	vt_history_budget_set(SCROLL_BUDGET);
 	vt_keytable_set(keytable, LENGTH(keytable));
 	for (unsigned int i = 0; i < LENGTH(colors); i++) {
 		if (COLORS == 256) {
@@ -1228,6 +2056,10 @@ setup(void) {
 		colors[i].pair = vt_color_reserve(colors[i].fg, colors[i].bg);
 	}
 	initpertag();
+	keyindex_build(&bindings_index, bindings, LENGTH(bindings));
+	keyindex_build(&modkeyb_index, min_bindings, LENGTH(min_bindings));
+	keyindex_build(&usrkeyb_index, usrkeyb, usrkeybn);
+	cmdindex_build();
 	resize_screen();
 	struct sigaction sa;
 	memset(&sa, 0, sizeof sa);
@@ -1260,10 +2092,32 @@ destroy(Client *c) {
 	}
 	if (lastsel == c)
 		lastsel = NULL;
-	werase(c->window);
-	wnoutrefresh(c->window);
+	split_detach(c);
+	sendevtfmt(EVT_DESTROY, "destroy %d\n", c->id);
+	if (c->arranged) {
+		vacate(c);
+		arrange_damaged = true;
+	}
+	tap_close(c);
+	if (transfer.client == c)
+		transfer.client = NULL;
+	for (Transfer *t = transfers; t; t = t->next) {
+		if (t->client == c)
+			t->client = NULL;
+	}
+	if (c->is_editor && c->editor_fds[1] != -1)
+		close(c->editor_fds[1]);
+	rope_free(&c->edited);
+	intmap_del(&client_ids, c->id, c);
+	intmap_del(&client_pids, c->pid, c);
+	if (c->overlay)
+		intmap_del(&client_pids, vt_pid_get(c->overlay), c);
+	if (c->window) {
+		werase(c->window);
+		wnoutrefresh(c->window);
+		delwin(c->window);
+	}
 	vt_destroy(c->term);
-	delwin(c->window);
 	if (!clients && LENGTH(actions)) {
 		if (!strcmp(c->cmd, shell))
 			quit(NULL);
@@ -1277,11 +2131,29 @@ destroy(Client *c) {
 static void
 cleanup(void) {
 	int i;
+	while (cmdsock.conns)
+		cmdconn_close(cmdsock.conns);
 	while (clients)
 		destroy(clients);
+	/* hand the remaining output of the taps to their processes */
+	while (taps) {
+		Tap *tap = taps;
+		taps = tap->next;
+		fcntl(tap->fd, F_SETFL, 0);
+		tap_write(tap);
+		tap_free(tap);
+	}
+	for (unsigned int t = 0; t < LENGTH(pertag.split); t++)
+		split_free(pertag.split[t]);
 	vt_shutdown();
 	endwin();
-	free(copyreg.data);
+	for (unsigned int r = 0; r < LENGTH(copyregs); r++)
+		rope_free(&copyregs[r]);
+	while (transfers) {
+		Transfer *t = transfers;
+		transfers = t->next;
+		free(t);
+	}
 	if (bar.fd > 0)
 		close(bar.fd);
 	if (bar.file)
@@ -1302,13 +2174,29 @@ cleanup(void) {
 		close(retfifo.fd);
 	if (retfifo.file)
 		unlink(retfifo.file);
+	if (cmdsock.fd != -1)
+		close(cmdsock.fd);
+	if (cmdsock.file)
+		unlink(cmdsock.file);
 	for(i=0; i <= LENGTH(tags); i++) {
 		free(pertag.name[i]);
 		free(pertag.cwd[i]);
+		free(pertag.cache[i].rects);
 	}
 	for(i=0; i < usrkeybn; i++)
 		free((char *) usrkeyb[i].action.args[0]);
 	free(usrkeyb);
+	keyindex_free(&bindings_index);
+	keyindex_free(&modkeyb_index);
+	keyindex_free(&usrkeyb_index);
+	free(commands_index.slots);
+	intmap_free(&client_ids);
+	intmap_free(&client_pids);
+	if (tracer.used) {
+		char buf[256];
+		trace_format(buf, sizeof buf);
+		fprintf(stderr, "%s\n", buf);
+	}
 }
 
 static char *getcwd_by_pid(Client *c) {
@@ -1382,14 +2270,9 @@ create(const char *args[]) {
 	c->id = ++cmdfifo.id;
 	snprintf(buf, sizeof buf, "%d", c->id);
 
-	if (!(c->window = newwin(wah, waw, way, wax))) {
-		free(c);
-		return;
-	}
-
+	/* the curses window is created once the client is arranged */
 	c->term = c->app = vt_create(screen.h, screen.w, screen.history);
 	if (!c->term) {
-		delwin(c->window);
 		free(c);
 		return;
 	}
@@ -1425,6 +2308,10 @@ create(const char *args[]) {
 	vt_data_set(c->term, c);
 	vt_title_handler_set(c->term, term_title_handler);
 	vt_urgent_handler_set(c->term, term_urgent_handler);
+	intmap_put(&client_ids, c->id, c);
+	if (c->pid > 0)
+		intmap_put(&client_pids, c->pid, c);
+	sendevtfmt(EVT_CREATE, "create %d %d\n", c->id, (int)c->pid);
 	applycolorrules(c);
 	c->x = wax;
 	c->y = way;
@@ -1476,6 +2363,7 @@ copymode(const char *args[]) {
 	}
 
 	sel->term = sel->overlay;
+	intmap_put(&client_pids, vt_pid_get(sel->overlay), sel);
 
 	if (sel->editor_fds[0] != -1) {
 		char *buf = NULL;
@@ -1501,60 +2389,317 @@ copymode(const char *args[]) {
 		vt_write(sel->overlay, args[1], strlen(args[1]));
 }
 
+/* maps a register name to the register, the default one is 0 or " */
+static Rope *
+copyreg_get(const char *name) {
+	if (!name || !strcmp(name, "\""))
+		return &copyregs[0];
+	if (name[0] >= '0' && name[0] <= '9' && !name[1])
+		return &copyregs[name[0] - '0'];
+	if (name[0] >= 'a' && name[0] <= 'z' && !name[1])
+		return &copyregs[REGISTER_HISTORY + name[0] - 'a'];
+	return NULL;
+}
+
+/* returns the emptied register to store new content in. Storing into the
+ * default register moves its history by one, the history itself is read
+ * only. */
+static Rope *
+copyreg_new(const char *name) {
+	Rope *r = copyreg_get(name);
+
+	if (r == &copyregs[0]) {
+		rope_free(&copyregs[REGISTER_HISTORY - 1]);
+		memmove(&copyregs[1], &copyregs[0], (REGISTER_HISTORY - 1) * sizeof(Rope));
+		copyregs[0] = (Rope){ 0 };
+		/* keep an ongoing transfer filling the register it started with */
+		if (transfer.rope >= &copyregs[0] && transfer.rope < &copyregs[REGISTER_HISTORY - 1])
+			transfer.rope++;
+		else if (transfer.rope == &copyregs[REGISTER_HISTORY - 1])
+			transfer.rope = NULL;
+	} else if (r && r < &copyregs[REGISTER_HISTORY]) {
+		return NULL;
+	} else if (r) {
+		if (transfer.rope == r)
+			transfer.rope = NULL;
+		rope_free(r);
+	}
+	return r;
+}
+
+/* copies the register into an unlinked file, to be passed to clients of
+ * the command socket */
+static int
+copyreg_export(Rope *r) {
+	int fd;
+#ifdef MFD_CLOEXEC
+	fd = memfd_create("dvtm-register", MFD_CLOEXEC);
+#else
+	char path[PATH_MAX];
+	const char *tmpdir = getenv("TMPDIR");
+	snprintf(path, sizeof path, "%s/dvtm-register-XXXXXX", tmpdir ? tmpdir : "/tmp");
+	if ((fd = mkstemp(path)) != -1)
+		unlink(path);
+#endif
+	if (fd == -1)
+		return -1;
+
+	for (Chunk *c = r->head; c; c = c->next) {
+		for (size_t pos = 0; pos < c->len; ) {
+			ssize_t len = write(fd, c->data + pos, c->len - pos);
+			if (len < 0) {
+				if (errno == EINTR)
+					continue;
+				close(fd);
+				return -1;
+			}
+			pos += len;
+		}
+	}
+	lseek(fd, 0, SEEK_SET);
+	return fd;
+}
+
+/* reads a regular file received from a client into the register */
+static void
+copyreg_import(Rope *r, int fd) {
+	struct stat info;
+	off_t off = 0;
+	size_t avail;
+	ssize_t len;
+	char *buf;
+
+	if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode))
+		return;
+
+	while ((buf = rope_space(r, &avail))) {
+		len = pread(fd, buf, avail, off);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+		rope_commit(r, len);
+		off += len;
+	}
+}
+
 static void
 copybuf(const char *args[]) {
-	char buf[1024];
-	int offs = 0;
-	int len;
+	const char *name = NULL;
+	bool sized = false;
+	size_t size = 0, avail;
+	ssize_t len;
+	char *buf;
+	Rope *r;
 
 	if (!args || !args[0])
 		return;
 
+	for (int i = 1; i < 3 && args[i]; i++) {
+		/* the history can not be written to, put takes numbers as length */
+		if (!strcmp(args[0], "put") && args[i][0] >= '0' && args[i][0] <= '9') {
+			size = strtoul(args[i], NULL, 10);
+			sized = true;
+		} else {
+			name = args[i];
+		}
+	}
+
 	if (strcmp(args[0], "put") == 0) {
-		copyreg.len = 0;
+		if (sized) {
+			/* the data is stored from the main loop as it arrives */
+			transfer_queue(NULL, name ? name : "\"", size, false);
+			return;
+		}
 
+		if (transfer.left || !(r = copyreg_new(name)))
+			return;
 		do {
-			len = read(cpyfifo.fd, buf, sizeof(buf));
+			if (!(buf = rope_space(r, &avail)))
+				break;
+			len = read(cpyfifo.fd, buf, avail);
 			if (len <= 0)
 				break;
+			rope_commit(r, len);
+		} while ((size_t)len == avail);
+	} else if (strcmp(args[0], "get") == 0) {
+		if (!(r = copyreg_get(name)))
+			return;
+		if (cmdsock.current) {
+			for (Chunk *c = r->head; c; c = c->next)
+				register_append(&cmdsock.current->out, c->data, c->len);
+			return;
+		}
+		if (!(buf = malloc(r->len + 1)))
+			return;
+		size_t pos = 0;
+		for (Chunk *c = r->head; c; c = c->next) {
+			memcpy(buf + pos, c->data, c->len);
+			pos += c->len;
+		}
+		doret(buf, pos);
+		free(buf);
+	} else if (strcmp(args[0], "getfd") == 0) {
+		CmdConn *conn = cmdsock.current;
+		char reply[32];
+		int fd;
 
-			if (!copyreg.data) {
-				copyreg.data = malloc(sizeof(buf));
-				copyreg.size = sizeof(buf);
-			}
+		if (!conn || conn->fdout != -1 || !(r = copyreg_get(name)))
+			return;
+		if ((fd = copyreg_export(r)) == -1)
+			return;
+		conn->fdout = fd;
+		conn->fdout_pos = conn->frame;
+		len = snprintf(reply, sizeof reply, "%zu", r->len);
+		doret(reply, len);
+	} else if (strcmp(args[0], "putfd") == 0) {
+		CmdConn *conn = cmdsock.current;
+
+		if (!conn || conn->fdin == -1)
+			return;
+		/* the file does not pass the copy fifo, an ongoing transfer
+		 * into the same register is superseded by it */
+		if ((r = copyreg_new(name)))
+			copyreg_import(r, conn->fdin);
+		close(conn->fdin);
+		conn->fdin = -1;
+	} else if (strcmp(args[0], "list") == 0) {
+		char line[32];
+
+		for (size_t i = 0; i < LENGTH(copyregs); i++) {
+			if (!copyregs[i].len)
+				continue;
+			char reg = i < REGISTER_HISTORY ? '0' + i : 'a' + i - REGISTER_HISTORY;
+			len = snprintf(line, sizeof line, "%c %zu\n", reg, copyregs[i].len);
+			if (cmdsock.current)
+				register_append(&cmdsock.current->out, line, len);
+			else
+				doret(line, len - 1);
+		}
+	}
+}
 
-			copyreg.len += len;
+/* starts the next announced transfer once the current one completed */
+static void
+transfer_next(void) {
+	while (!transfer.left && transfers) {
+		Transfer *t = transfers;
+		transfers = t->next;
+		transfer = *t;
+		transfer.next = NULL;
+		free(t);
+		if (transfer.reg[0])
+			transfer.rope = copyreg_new(transfer.reg);
+	}
+}
 
-			if (copyreg.len > copyreg.size) {
-				copyreg.data = realloc(copyreg.data, copyreg.len);
-				copyreg.size = copyreg.len;
-			}
+/* announces size bytes on the copy fifo, which are stored in the register
+ * reg or forwarded to c. Invalid or read only registers and vanished clients
+ * still consume them, to keep the following transfers in sync. */
+static void
+transfer_queue(Client *c, const char *reg, size_t size, bool paste) {
+	Transfer *t, **last = &transfers;
 
-			memcpy(copyreg.data + offs, buf, len);
-			offs += len;
-		} while (len == sizeof(buf));
-	} else if (strcmp(args[0], "get") == 0) {
-		doret(copyreg.data, copyreg.len);
+	if (!size || !(t = calloc(1, sizeof *t)))
+		return;
+	if (reg && strlen(reg) < sizeof t->reg && copyreg_get(reg))
+		strcpy(t->reg, reg);
+	else if (!reg)
+		t->client = c;
+	t->left = size;
+	t->paste = paste;
+	while (*last)
+		last = &(*last)->next;
+	*last = t;
+	transfer_next();
+}
+
+/* forwards the next chunk of an announced transfer from the copy fifo,
+ * data for a client which is gone is discarded. Pasted chunks are
+ * bracketed one by one, keys typed in between are not part of them. */
+static void
+handle_transfer(void) {
+	static char buf[1 << 16];
+	size_t avail;
+	ssize_t len;
+
+	if (transfer.rope) {
+		char *space = rope_space(transfer.rope, &avail);
+		if (!space) {
+			/* out of memory, discard the rest */
+			transfer.rope = NULL;
+			return;
+		}
+		len = read(cpyfifo.fd, space, MIN(transfer.left, avail));
+		if (len <= 0)
+			return;
+		rope_commit(transfer.rope, len);
+		if (!(transfer.left -= len)) {
+			transfer.rope = NULL;
+			transfer_next();
+		}
+		return;
+	}
+
+	len = read(cpyfifo.fd, buf, MIN(transfer.left, sizeof(buf)));
+	if (len <= 0)
+		return;
+
+	transfer.left -= len;
+	if (transfer.client && transfer.paste) {
+		vt_paste_begin(transfer.client->app);
+		vt_paste(transfer.client->app, buf, len);
+		vt_paste_end(transfer.client->app);
+	} else if (transfer.client) {
+		vt_write(transfer.client->app, buf, len);
 	}
+	transfer_next();
 }
 
 static void
 sendtext(const char *args[]) {
-	char buf[512];
-	int len;
+	char buf[BUFSIZ];
+	ssize_t len;
 
-	if (!sel || !args || !args[0])
+	if (!args || !args[0])
 		return;
 
 	if (strcmp(args[0], "-") == 0) {
+		bool paste = false, sized = false;
+		size_t size = 0;
+
+		for (int i = 1; i < 3 && args[i]; i++) {
+			if (!strcmp(args[i], "paste")) {
+				paste = true;
+			} else {
+				size = strtoul(args[i], NULL, 10);
+				sized = true;
+			}
+		}
+
+		if (sized) {
+			/* the data is forwarded from the main loop as it arrives */
+			transfer_queue(sel, NULL, size, paste);
+			return;
+		}
+
+		if (!sel)
+			return;
+		if (paste)
+			vt_paste_begin(sel->app);
 		do {
 			len = read(cpyfifo.fd, buf, sizeof(buf));
 			if (len <= 0)
 				break;
 
-			vt_write(sel->app, buf, len);
+			if (paste)
+				vt_paste(sel->app, buf, len);
+			else
+				vt_write(sel->app, buf, len);
 		} while (len == sizeof(buf));
-	} else {
+		if (paste)
+			vt_paste_end(sel->app);
+	} else if (sel) {
 	    vt_write(sel->app, args[0], strlen(args[0]));
 	}
 }
@@ -1572,125 +2717,471 @@ capture(const char *args[]) {
 }
 
 static void
-focusn(const char *args[]) {
-	for (Client *c = nextvisible(clients); c; c = nextvisible(c->next)) {
-		if (c->order == atoi(args[0])) {
-			focus(c);
-			if (c->minimized)
-				toggleminimize(NULL);
-			return;
-		}
+region(const char *args[]) {
+	unsigned int argc = 0;
+	int val[5] = { 0, 0, 1, 0, 0 };
+	bool colored = false;
+	char *buf = NULL;
+	size_t len;
+
+	for (int i = 0; args && i < MAX_ARGS && args[i]; i++) {
+		if (!strcmp(args[i], "color"))
+			colored = true;
+		else if (argc < LENGTH(val))
+			val[argc++] = atoi(args[i]);
 	}
-}
+	if (argc < 2)
+		return;
 
-static void
-focusid(const char *args[]) {
-	if (!args[0])
+	Client *c = intmap_get(&client_ids, val[0]);
+	if (!c)
 		return;
 
-	const int win_id = atoi(args[0]);
-	for (Client *c = clients; c; c = c->next) {
-		if (c->id == win_id) {
-			focus(c);
-			if (c->minimized)
-				toggleminimize(NULL);
-			if (!isvisible(c)) {
-				c->tags |= tagset[seltags];
-				tagschanged();
-			}
-			return;
-		}
-	}
+	len = vt_region_get(c->app, &buf, val[1], val[2], val[3], val[4], colored);
+	/* doret terminates the reply with a newline itself */
+	doret(buf ? buf : "", len ? len - 1 : 0);
+	free(buf);
 }
 
 static void
-focusnext(const char *args[]) {
-	Client *c;
-	if (!sel)
-		return;
-	for (c = sel->next; c && !isvisible(c); c = c->next);
-	if (!c)
-		for (c = clients; c && !isvisible(c); c = c->next);
-	if (c)
-		focus(c);
+stats(const char *args[]) {
+	char *buf = NULL;
+	size_t len = 0, size = 0;
+	int id = args && args[0] ? atoi(args[0]) : 0;
+
+	Client *first = id ? intmap_get(&client_ids, id) : clients;
+
+	for (Client *c = first; c; c = id ? NULL : c->next) {
+		const VtStats *v = vt_stats_get(c->app);
+		ClientStats *s = &c->stats;
+		char line[512];
+		int n = snprintf(line, sizeof line, "%d bytes=%llu reads=%llu csi=%llu osc=%llu esc=%llu "
+		                 "cancelled=%llu scrolled=%llu repainted=%llu cells=%llu "
+		                 "process_us=%llu draw_us=%llu latency_avg_us=%llu latency_max_us=%llu "
+		                 "tap_queued=%zu tap_dropped=%llu write_queued=%zu "
+		                 "history=%d history_bytes=%zu evicted=%llu\n",
+		                 c->id, v->bytes, v->reads, v->csi, v->osc, v->esc,
+		                 v->cancelled, v->scrolled, v->repainted, v->cells,
+		                 (unsigned long long)s->process_ns / 1000,
+		                 (unsigned long long)s->draw_ns / 1000,
+		                 (unsigned long long)(s->latency_count ? s->latency_ns / s->latency_count / 1000 : 0),
+		                 (unsigned long long)s->latency_max_ns / 1000,
+		                 c->tap ? c->tap->queue.len : 0, c->tap ? c->tap->dropped : 0,
+		                 vt_write_pending(c->term), v->history, v->history_bytes, v->evicted);
+		if (n < 0)
+			continue;
+		if (len + n > size) {
+			size = (len + n) * 2;
+			char *tmp = realloc(buf, size);
+			if (!tmp)
+				break;
+			buf = tmp;
+		}
+		memcpy(buf + len, line, n);
+		len += n;
+	}
+
+	/* doret terminates the reply with a newline itself */
+	doret(buf ? buf : "", len ? len - 1 : 0);
+	free(buf);
 }
 
 static void
-focusnextnm(const char *args[]) {
-	if (!sel)
+tap_handler(Vt *term, const char *buf, size_t len) {
+	Client *c = (Client *)vt_data_get(term);
+	Tap *tap = c->tap;
+
+	if (!tap)
 		return;
-	Client *c = sel;
-	do {
-		c = nextvisible(c->next);
-		if (!c)
-			c = nextvisible(clients);
-	} while (c->minimized && c != sel);
-	focus(c);
+	if (tap->queue.len + len > TAP_QUEUE_MAX || !register_append(&tap->queue, buf, len))
+		tap->dropped += len;
 }
 
-static void
-focusprev(const char *args[]) {
-	Client *c;
-	if (!sel)
-		return;
-	for (c = sel->prev; c && !isvisible(c); c = c->prev);
-	if (!c) {
-		for (c = clients; c && c->next; c = c->next);
-		for (; c && !isvisible(c); c = c->prev);
-	}
-	if (c)
-		focus(c);
+/* whether reading from the pane is suspended until its tap caught up */
+static bool
+tap_throttled(Client *c) {
+	return c->tap && c->tap->throttle && c->tap->queue.len > TAP_QUEUE_MAX - BUFSIZ;
 }
 
-static void
-focusprevnm(const char *args[]) {
-	if (!sel)
-		return;
-	Client *c = sel;
-	do {
-		for (c = c->prev; c && !isvisible(c); c = c->prev);
-		if (!c) {
-			for (c = clients; c && c->next; c = c->next);
-			for (; c && !isvisible(c); c = c->prev);
+/* writes as much of the queue as the pipe takes, returns false if it broke */
+static bool
+tap_write(Tap *tap) {
+	while (tap->queue.len) {
+		ssize_t len = write(tap->fd, tap->queue.data, tap->queue.len);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK;
 		}
-	} while (c && c != sel && c->minimized);
-	focus(c);
+		register_consume(&tap->queue, len);
+	}
+	return true;
 }
 
 static void
-focuslast(const char *args[]) {
-	if (lastsel)
-		focus(lastsel);
+tap_free(Tap *tap) {
+	close(tap->fd);
+	free(tap->queue.data);
+	free(tap);
 }
 
 static void
-focusup(const char *args[]) {
-	if (!sel)
-		return;
-	/* avoid vertical separator, hence +1 in x direction */
-	Client *c = get_client_by_coord(sel->x + 1, sel->y - 1);
-	if (c)
-		focus(c);
-	else
-		focusprev(args);
+tap_flush(Client *c) {
+	if (!tap_write(c->tap))
+		tap_close(c);
 }
 
+/* the pipe is closed once the queued output is written, the process
+ * then exits on end of file */
 static void
-focusdown(const char *args[]) {
-	if (!sel)
+tap_close(Client *c) {
+	Tap *tap = c->tap;
+
+	if (!tap)
 		return;
-	Client *c = get_client_by_coord(sel->x, sel->y + sel->h);
-	if (c)
-		focus(c);
-	else
-		focusnext(args);
+	vt_tap_handler_set(c->app, NULL);
+	c->tap = NULL;
+	if (!tap_write(tap) || !tap->queue.len) {
+		tap_free(tap);
+		return;
+	}
+	tap->next = taps;
+	taps = tap;
 }
 
 static void
-focusleft(const char *args[]) {
+taps_flush(fd_set *wr) {
+	for (Tap **t = &taps, *tap; (tap = *t); ) {
+		if (FD_ISSET(tap->fd, wr) && (!tap_write(tap) || !tap->queue.len)) {
+			*t = tap->next;
+			tap_free(tap);
+		} else {
+			t = &tap->next;
+		}
+	}
+}
+
+/* the output is written through a pipe to a child process which either
+ * appends it to a file or runs the given |command, hence a slow disk
+ * never blocks dvtm itself */
+static Tap*
+tap_open(const char *target) {
+	int fds[2], out = -1;
+	Tap *tap;
+
+	if (target[0] != '|' && (out = open(target, O_WRONLY|O_CREAT|O_APPEND, 0666)) == -1)
+		return NULL;
+	if (!(tap = calloc(1, sizeof(*tap))) || pipe(fds) == -1) {
+		free(tap);
+		if (out != -1)
+			close(out);
+		return NULL;
+	}
+
+	if ((tap->pid = fork()) == -1) {
+		close(fds[0]);
+		close(fds[1]);
+		if (out != -1)
+			close(out);
+		free(tap);
+		return NULL;
+	}
+
+	if (tap->pid == 0) {
+		sigset_t emptyset;
+		sigemptyset(&emptyset);
+		sigprocmask(SIG_SETMASK, &emptyset, NULL);
+		signal(SIGPIPE, SIG_DFL);
+
+		if (out == -1)
+			out = open("/dev/null", O_WRONLY);
+		dup2(fds[0], STDIN_FILENO);
+		dup2(out, STDOUT_FILENO);
+		dup2(out, STDERR_FILENO);
+
+		int maxfd = sysconf(_SC_OPEN_MAX);
+		for (int fd = 3; fd < maxfd; fd++)
+			if (close(fd) == -1 && errno == EBADF)
+				break;
+
+		if (target[0] == '|') {
+			execl("/bin/sh", "sh", "-c", target + 1, (char *)NULL);
+			_exit(127);
+		}
+
+		char buf[BUFSIZ];
+		ssize_t len;
+		while ((len = read(STDIN_FILENO, buf, sizeof buf)) > 0) {
+			for (ssize_t pos = 0, res; pos < len; pos += res) {
+				if ((res = write(STDOUT_FILENO, buf + pos, len - pos)) < 0)
+					_exit(1);
+			}
+		}
+		_exit(0);
+	}
+
+	close(fds[0]);
+	if (out != -1)
+		close(out);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	tap->fd = fds[1];
+	return tap;
+}
+
+static void
+tap(const char *args[]) {
+	if (!args || !args[0] || !args[1])
+		return;
+
+	Client *c = intmap_get(&client_ids, atoi(args[0]));
+	if (!c)
+		return;
+
+	tap_close(c);
+	if (!strcmp(args[1], "off"))
+		return;
+
+	if (!(c->tap = tap_open(args[1])))
+		return;
+	c->tap->throttle = args[2] && !strcmp(args[2], "throttle");
+	vt_tap_handler_set(c->app, tap_handler);
+}
+
+static void
+histogram_add(Histogram *h, uint64_t ns) {
+	unsigned int i = 0;
+	for (uint64_t us = ns / 1000; us && i < TRACE_BUCKETS - 1; us >>= 1)
+		i++;
+	h->buckets[i]++;
+	h->count++;
+	h->max_ns = MAX(h->max_ns, ns);
+}
+
+/* upper bound in µs of the bucket containing the given percentile */
+static unsigned long long
+histogram_percentile(Histogram *h, unsigned int percentile) {
+	unsigned long sum = 0, rank = (h->count * percentile + 99) / 100;
+	if (!h->count)
+		return 0;
+	for (unsigned int i = 0; i < TRACE_BUCKETS; i++) {
+		sum += h->buckets[i];
+		if (sum >= rank)
+			return MIN(1ULL << i, h->max_ns / 1000);
+	}
+	return h->max_ns / 1000;
+}
+
+static int
+histogram_format(char *buf, size_t size, const char *name, Histogram *h) {
+	return snprintf(buf, size, "%s count=%lu p50_us=%llu p90_us=%llu p99_us=%llu max_us=%llu",
+	                name, h->count, histogram_percentile(h, 50), histogram_percentile(h, 90),
+	                histogram_percentile(h, 99), (unsigned long long)h->max_ns / 1000);
+}
+
+static size_t
+trace_format(char *buf, size_t size) {
+	int len = histogram_format(buf, size, "read", &tracer.read);
+	buf[len++] = '\n';
+	return len + histogram_format(buf + len, size - len, "screen", &tracer.screen);
+}
+
+/* completes the traces of all keys whose echo was just drawn */
+static void
+trace_update(void) {
+	uint64_t now = 0;
+	for (Client *c = clients; c; c = c->next) {
+		if (!c->stats.trace_read_ns)
+			continue;
+		if (!now)
+			now = timestamp_ns();
+		if (is_content_visible(c))
+			histogram_add(&tracer.screen, now - c->stats.trace_key_ns);
+		c->stats.trace_key_ns = c->stats.trace_read_ns = 0;
+	}
+}
+
+static void
+batch_start(void) {
+	if (batch)
+		batch->depth++;
+}
+
+/* applies what was deferred by the outermost batch of the current source */
+static void
+batch_end(void) {
+	Batch *b = batch;
+
+	if (!b || !b->depth || --b->depth)
+		return;
+	batch = NULL;
+	if (b->arrange)
+		arrange();
+	else if (b->draw)
+		draw_all();
+	b->arrange = b->draw = false;
+	batch = b;
+}
+
+/* the requests of one read are always batched, so only a batch begun
+ * explicitly can be committed. Key bindings have no batch. */
+static void
+batchbegin(const char *args[]) {
+	batch_start();
+}
+
+static void
+batchcommit(const char *args[]) {
+	if (batch && batch->depth > 1)
+		batch_end();
+}
+
+static void
+tracelatency(const char *args[]) {
+	char buf[256];
+
+	if (!args || !args[0] || !strcmp(args[0], "dump")) {
+		doret(buf, trace_format(buf, sizeof buf));
+		return;
+	}
+
+	if (!strcmp(args[0], "on")) {
+		tracer.enabled = tracer.used = true;
+	} else if (!strcmp(args[0], "off")) {
+		tracer.enabled = false;
+	} else if (!strcmp(args[0], "reset")) {
+		memset(&tracer.read, 0, sizeof tracer.read);
+		memset(&tracer.screen, 0, sizeof tracer.screen);
+	} else {
+		return;
+	}
+
+	for (Client *c = clients; c; c = c->next)
+		c->stats.trace_key_ns = c->stats.trace_read_ns = 0;
+}
+
+static void
+focusn(const char *args[]) {
+	for (Client *c = nextvisible(clients); c; c = nextvisible(c->next)) {
+		if (c->order == atoi(args[0])) {
+			focus(c);
+			if (c->minimized)
+				toggleminimize(NULL);
+			return;
+		}
+	}
+}
+
+static void
+focusid(const char *args[]) {
+	if (!args[0])
+		return;
+
+	Client *c = intmap_get(&client_ids, atoi(args[0]));
+	if (!c)
+		return;
+
+	focus(c);
+	if (c->minimized)
+		toggleminimize(NULL);
+	if (!isvisible(c)) {
+		c->tags |= tagset[seltags];
+		sendevtfmt(EVT_TAG, "tags %d %u\n", c->id, c->tags);
+		tagschanged();
+	}
+}
+
+static void
+focusnext(const char *args[]) {
+	Client *c;
+	if (!sel)
+		return;
+	for (c = sel->next; c && !isvisible(c); c = c->next);
+	if (!c)
+		for (c = clients; c && !isvisible(c); c = c->next);
+	if (c)
+		focus(c);
+}
+
+static void
+focusnextnm(const char *args[]) {
+	if (!sel)
+		return;
+	Client *c = sel;
+	do {
+		c = nextvisible(c->next);
+		if (!c)
+			c = nextvisible(clients);
+	} while (c->minimized && c != sel);
+	focus(c);
+}
+
+static void
+focusprev(const char *args[]) {
+	Client *c;
+	if (!sel)
+		return;
+	for (c = sel->prev; c && !isvisible(c); c = c->prev);
+	if (!c) {
+		for (c = clients; c && c->next; c = c->next);
+		for (; c && !isvisible(c); c = c->prev);
+	}
+	if (c)
+		focus(c);
+}
+
+static void
+focusprevnm(const char *args[]) {
+	if (!sel)
+		return;
+	Client *c = sel;
+	do {
+		for (c = c->prev; c && !isvisible(c); c = c->prev);
+		if (!c) {
+			for (c = clients; c && c->next; c = c->next);
+			for (; c && !isvisible(c); c = c->prev);
+		}
+	} while (c && c != sel && c->minimized);
+	focus(c);
+}
+
+static void
+focuslast(const char *args[]) {
+	if (lastsel)
+		focus(lastsel);
+}
+
+static void
+focusup(const char *args[]) {
+	if (!sel)
+		return;
+	/* avoid vertical separator, hence +1 in x direction */
+	Client *c = isarrange(splittree) ? split_neighbour(sel, false, 0) :
+	            get_client_by_coord(sel->x + 1, sel->y - 1);
+	if (c)
+		focus(c);
+	else
+		focusprev(args);
+}
+
+static void
+focusdown(const char *args[]) {
+	if (!sel)
+		return;
+	Client *c = isarrange(splittree) ? split_neighbour(sel, false, 1) :
+	            get_client_by_coord(sel->x, sel->y + sel->h);
+	if (c)
+		focus(c);
+	else
+		focusnext(args);
+}
+
+static void
+focusleft(const char *args[]) {
 	if (!sel)
 		return;
-	Client *c = get_client_by_coord(sel->x - 2, sel->y);
+	Client *c = isarrange(splittree) ? split_neighbour(sel, true, 0) :
+	            get_client_by_coord(sel->x - 2, sel->y);
 	if (c)
 		focus(c);
 	else
@@ -1701,7 +3192,8 @@ static void
 focusright(const char *args[]) {
 	if (!sel)
 		return;
-	Client *c = get_client_by_coord(sel->x + sel->w + 1, sel->y);
+	Client *c = isarrange(splittree) ? split_neighbour(sel, true, 1) :
+	            get_client_by_coord(sel->x + sel->w + 1, sel->y);
 	if (c)
 		focus(c);
 	else
@@ -1767,16 +3259,34 @@ static void killother(const char *args[]) {
 	}
 }
 
+static char
+rope_at(Rope *r, size_t pos) {
+	Chunk *c = r->head;
+	while (pos >= c->len) {
+		pos -= c->len;
+		c = c->next;
+	}
+	return c->data[pos];
+}
+
 static void
 paste(const char *args[]) {
-	if (sel && copyreg.data) {
-		size_t len = copyreg.len;
+	Rope *r = copyreg_get(args ? args[0] : NULL);
+
+	if (sel && r && r->len) {
+		size_t len = r->len;
 
-		if (copyreg.data[len - 2] == '\r')
+		if (len > 1 && rope_at(r, len - 2) == '\r')
 			len--;
-		if (copyreg.data[len - 1] == '\n')
+		if (rope_at(r, len - 1) == '\n')
 			len--;
-		vt_write(sel->term, copyreg.data, len);
+		vt_paste_begin(sel->term);
+		for (Chunk *c = r->head; c && len; c = c->next) {
+			size_t n = MIN(c->len, len);
+			vt_paste(sel->term, c->data, n);
+			len -= n;
+		}
+		vt_paste_end(sel->term);
 	}
 }
 
@@ -1789,7 +3299,8 @@ quit(const char *args[]) {
 static void
 redraw(const char *args[]) {
 	for (Client *c = clients; c; c = c->next) {
-		if (!c->minimized) {
+		/* hidden clients have no window, they are drawn once shown */
+		if (!c->minimized && c->window && isvisible(c)) {
 			vt_dirty(c->term);
 			wclear(c->window);
 			wnoutrefresh(c->window);
@@ -1813,7 +3324,7 @@ scrollback(const char *args[]) {
 }
 
 static void
-send(const char *args[]) {
+sendkeys(const char *args[]) {
 	if (sel && args && args[0])
 		vt_write(sel->term, args[0], strlen(args[0]));
 }
@@ -1886,7 +3397,11 @@ setmfact(const char *args[]) {
 	if (isarrange(fullscreen) || isarrange(grid))
 		return;
 
-	mfact = pertag.mfact[pertag.curtag];
+	/* in the split layout the split around the focused window is resized */
+	Split *node = isarrange(splittree) && sel && sel->leaf ? sel->leaf->parent : NULL;
+	if (isarrange(splittree) && !node)
+		return;
+	mfact = node ? node->ratio : pertag.mfact[pertag.curtag];
 
 	/* arg handling, manipulate mfact */
 	if (args[0] == NULL) {
@@ -1902,10 +3417,37 @@ setmfact(const char *args[]) {
 			mfact = 0.9;
 	}
 
-	pertag.mfact[pertag.curtag] = mfact;
+	if (node) {
+		node->ratio = mfact;
+		split_touch(node);
+	} else {
+		pertag.mfact[pertag.curtag] = mfact;
+	}
 	arrange();
 }
 
+/* split [h|v|auto|swap]: orientation of the next split in the split layout,
+ * or swap both sides of the split around the focused window */
+static void
+split(const char *args[]) {
+	if (!args[0])
+		return;
+	if (!strcmp(args[0], "swap")) {
+		Split *s = sel && sel->leaf && isarrange(splittree) ? sel->leaf->parent : NULL;
+		if (!s)
+			return;
+		Split *tmp = s->child[0];
+		s->child[0] = s->child[1];
+		s->child[1] = tmp;
+		split_touch(s);
+		arrange();
+	} else if (!strcmp(args[0], "h") || !strcmp(args[0], "v")) {
+		pertag.splitdir[pertag.curtag] = args[0][0];
+	} else if (!strcmp(args[0], "auto")) {
+		pertag.splitdir[pertag.curtag] = 0;
+	}
+}
+
 static float
 getmfact(void) {
 	return pertag.mfact[pertag.curtag];
@@ -2047,26 +3589,163 @@ setcwd(const char *args[]) {
 	drawbar();
 }
 
+static size_t
+ring_free(Ring *r) {
+	return sizeof(r->data) - r->len;
+}
+
+static void
+ring_put(Ring *r, const char *data, size_t len) {
+	for (size_t pos = (r->start + r->len) % sizeof(r->data), n; len; pos = 0) {
+		n = MIN(len, sizeof(r->data) - pos);
+		memcpy(r->data + pos, data, n);
+		r->len += n;
+		data += n;
+		len -= n;
+	}
+}
+
+/* fills iov with the (at most two) contiguous parts of the ring */
+static int
+ring_iov(Ring *r, struct iovec iov[2]) {
+	size_t n = MIN(r->len, sizeof(r->data) - r->start);
+	iov[0].iov_base = r->data + r->start;
+	iov[0].iov_len = n;
+	iov[1].iov_base = r->data;
+	iov[1].iov_len = r->len - n;
+	return r->len > n ? 2 : 1;
+}
+
+static void
+ring_consume(Ring *r, size_t len) {
+	r->start = (r->start + len) % sizeof(r->data);
+	r->len -= len;
+}
+
+/* tells the consumer how many events it missed, once there is room */
+static bool
+evtsub_notify(EvtSub *sub, size_t reserve) {
+	char notice[32];
+	int len;
+
+	if (!sub->dropped)
+		return true;
+	len = snprintf(notice, sizeof notice, "dropped %lu\n", sub->dropped);
+	if (ring_free(&sub->ring) < len + reserve)
+		return false;
+	ring_put(&sub->ring, notice, len);
+	sub->dropped = 0;
+	return true;
+}
+
+static void
+evtsub_put(EvtSub *sub, const char *data, size_t len) {
+	if (!evtsub_notify(sub, len) || ring_free(&sub->ring) < len) {
+		sub->dropped++;
+		return;
+	}
+	ring_put(&sub->ring, data, len);
+}
+
+/* queues an event for every interested subscriber, they are written out
+ * once per main loop iteration by evt_flush() */
+static void
+evt_emit(unsigned int type, const char *data, size_t len) {
+	if (evtfifo.fd != -1 && (evtfifo_sub.filter & type))
+		evtsub_put(&evtfifo_sub, data, len);
+	for (CmdConn *conn = cmdsock.conns; conn; conn = conn->next) {
+		if (conn->evt && (conn->evt->filter & type))
+			evtsub_put(conn->evt, data, len);
+	}
+}
+
+/* what does not fit into the fifo is written once it becomes writable */
+static void
+evtfifo_flush(void) {
+	struct iovec iov[2];
+
+	if (evtfifo.fd == -1 || !evtfifo_sub.ring.len)
+		return;
+	ssize_t len = writev(evtfifo.fd, iov, ring_iov(&evtfifo_sub.ring, iov));
+	if (len > 0)
+		ring_consume(&evtfifo_sub.ring, len);
+}
+
+static void
+evt_flush(void) {
+	struct iovec iov[2];
+
+	if (evtfifo.fd != -1)
+		evtsub_notify(&evtfifo_sub, 0);
+	evtfifo_flush();
+
+	for (CmdConn *conn = cmdsock.conns, *next; conn; conn = next) {
+		next = conn->next;
+		EvtSub *sub = conn->evt;
+		if (sub)
+			evtsub_notify(sub, 0);
+		/* leave events in the ring while the peer lags behind */
+		if (!sub || !sub->ring.len || conn->out.len >= EVT_RING_SIZE)
+			continue;
+		uint32_t len = sub->ring.len | CMDSOCK_EVENT_FRAME;
+		unsigned char hdr[4] = { len >> 24, len >> 16, len >> 8, len };
+		int n = ring_iov(&sub->ring, iov);
+		if (!register_append(&conn->out, (char *)hdr, sizeof hdr) ||
+		    !register_append(&conn->out, iov[0].iov_base, iov[0].iov_len) ||
+		    (n == 2 && !register_append(&conn->out, iov[1].iov_base, iov[1].iov_len))) {
+			cmdconn_close(conn);
+			continue;
+		}
+		ring_consume(&sub->ring, sub->ring.len);
+		cmdconn_flush(conn);
+	}
+}
+
 static void senduserevt(const char *args[]) {
 	if (!args || !args[0] || !args[1])
 		return;
 
-	write(evtfifo.fd, args[0], (size_t)args[1]);
+	evt_emit(EVT_USER, args[0], (size_t)args[1]);
 }
 
-void sendevtfmt(const char *fmt, ... )
-{
-	char buf[256];
+static void
+sendevtfmt(unsigned int type, const char *fmt, ... ) {
+	char buf[512];
 	va_list args;
 	int len;
 
-	if (evtfifo.fd == -1)
-		return;
-
 	va_start (args, fmt);
 	len = vsnprintf(buf, sizeof(buf), fmt, args);
-	write(evtfifo.fd, buf, len);
 	va_end (args);
+	if (len > 0)
+		evt_emit(type, buf, MIN((size_t)len, sizeof(buf) - 1));
+}
+
+static void
+subscribe(const char *args[]) {
+	static const char *names[] = {
+		"focus", "title", "urgent", "tag", "create", "destroy", "user",
+	};
+	unsigned int filter = args && args[0] ? 0 : EVT_ALL;
+
+	for (int i = 0; args && i < MAX_ARGS && args[i]; i++) {
+		if (!strcmp(args[i], "all"))
+			filter = EVT_ALL;
+		for (unsigned int e = 0; e < LENGTH(names); e++) {
+			if (!strcmp(args[i], names[e]))
+				filter |= 1 << e;
+		}
+	}
+
+	if (!cmdsock.current) {
+		evtfifo_sub.filter = filter;
+		return;
+	}
+
+	CmdConn *conn = cmdsock.current;
+	if (!conn->evt && !(conn->evt = calloc(1, sizeof(*conn->evt))))
+		return;
+	conn->evt->filter = filter;
 }
 
 /* commands for use by mouse bindings */
@@ -2095,11 +3774,35 @@ mouse_zoom(const char *args[]) {
 	zoom(NULL);
 }
 
+static void
+cmdindex_build(void) {
+	CmdIndex *idx = &commands_index;
+
+	idx->size = hash_size(LENGTH(commands));
+	if (!(idx->slots = malloc(idx->size * sizeof(*idx->slots))))
+		error("fail on command index malloc\n");
+	for (unsigned int i = 0; i < idx->size; i++)
+		idx->slots[i] = -1;
+	for (unsigned int c = LENGTH(commands); c-- > 0; ) {
+		/* insert in reverse so the first of duplicate names wins */
+		unsigned int i = hash(commands[c].name, strlen(commands[c].name)) & (idx->size - 1);
+		while (idx->slots[i] != -1 && strcmp(commands[idx->slots[i]].name, commands[c].name))
+			i = (i + 1) & (idx->size - 1);
+		idx->slots[i] = c;
+	}
+}
+
 static Cmd *
 get_cmd_by_name(const char *name) {
-	for (unsigned int i = 0; i < LENGTH(commands); i++) {
-		if (!strcmp(name, commands[i].name))
-			return &commands[i];
+	CmdIndex *idx = &commands_index;
+
+	if (!idx->slots)
+		cmdindex_build();
+
+	unsigned int i = hash(name, strlen(name)) & (idx->size - 1);
+	for (; idx->slots[i] != -1; i = (i + 1) & (idx->size - 1)) {
+		if (!strcmp(name, commands[idx->slots[i]].name))
+			return &commands[idx->slots[i]];
 	}
 	return NULL;
 }
@@ -2176,34 +3879,337 @@ handle_cmd(char *cmdbuf) {
 					break;
 				}
 
-				if (c == '\n' || *p == '\n') {
-					if (!*p)
-						p++;
-					debug("execute %s", s);
-					for(int i = 0; i < argc; i++)
-						debug(" %s", args[i]);
-					debug("\n");
-					cmd->action.cmd(args);
-					break;
-				}
-			}
+				if (c == '\n' || *p == '\n') {
+					if (!*p)
+						p++;
+					debug("execute %s", s);
+					for(int i = 0; i < argc; i++)
+						debug(" %s", args[i]);
+					debug("\n");
+					cmd->action.cmd(args);
+					break;
+				}
+			}
+		}
+	}
+}
+
+static void
+handle_cmdfifo(void) {
+	char *p, cmdbuf[512];
+	int r;
+
+	r = read(cmdfifo.fd, cmdbuf, sizeof cmdbuf - 1);
+	if (r <= 0) {
+		cmdfifo.fd = -1;
+		return;
+	}
+
+	cmdbuf[r] = '\0';
+	batch = &fifobatch;
+	batch_start();
+	handle_cmd(cmdbuf);
+	/* batches do not outlive the read, commit those left open */
+	while (fifobatch.depth)
+		batch_end();
+	batch = NULL;
+}
+
+static bool
+register_append(Register *r, const char *data, size_t len) {
+	if (r->len + len > r->size) {
+		size_t size = MAX(r->size * 2, r->len + len);
+		char *tmp = realloc(r->data, size);
+		if (!tmp)
+			return false;
+		r->data = tmp;
+		r->size = size;
+	}
+	memcpy(r->data + r->len, data, len);
+	r->len += len;
+	return true;
+}
+
+static void
+register_consume(Register *r, size_t len) {
+	r->len -= len;
+	memmove(r->data, r->data + len, r->len);
+}
+
+/* returns the free space at the end of the rope, to be filled by the caller
+ * and accounted for by rope_commit */
+static char *
+rope_space(Rope *r, size_t *avail) {
+	if (!r->tail || r->tail->len == CHUNK_SIZE) {
+		Chunk *c = malloc(sizeof *c);
+		if (!c)
+			return NULL;
+		c->next = NULL;
+		c->len = 0;
+		if (r->tail)
+			r->tail->next = c;
+		else
+			r->head = c;
+		r->tail = c;
+	}
+	*avail = CHUNK_SIZE - r->tail->len;
+	return r->tail->data + r->tail->len;
+}
+
+static void
+rope_commit(Rope *r, size_t len) {
+	r->tail->len += len;
+	r->len += len;
+}
+
+static void
+rope_free(Rope *r) {
+	for (Chunk *c = r->head, *next; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+	r->head = r->tail = NULL;
+	r->len = 0;
+}
+
+static void
+cmdsock_listen(const char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	mode_t mask;
+	int bound;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		error("%s: socket path too long\n", path);
+	strcpy(addr.sun_path, path);
+	if ((cmdsock.fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		error("%s\n", strerror(errno));
+	/* commands are as good as keystrokes, only the owner may connect */
+	mask = umask(077);
+	bound = bind(cmdsock.fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (bound == -1)
+		error("%s: %s\n", path, strerror(errno));
+	cmdsock.file = path;
+	if (listen(cmdsock.fd, 8) == -1)
+		error("%s\n", strerror(errno));
+	fcntl(cmdsock.fd, F_SETFL, O_NONBLOCK);
+	fcntl(cmdsock.fd, F_SETFD, FD_CLOEXEC);
+}
+
+static void
+cmdconn_close(CmdConn *conn) {
+	Batch pending = conn->batch;
+
+	for (CmdConn **c = &cmdsock.conns; *c; c = &(*c)->next) {
+		if (*c == conn) {
+			*c = conn->next;
+			break;
+		}
+	}
+	close(conn->fd);
+	if (conn->fdin != -1)
+		close(conn->fdin);
+	if (conn->fdout != -1)
+		close(conn->fdout);
+	free(conn->evt);
+	free(conn->in.data);
+	free(conn->out.data);
+	if (batch == &conn->batch)
+		batch = NULL;
+	free(conn);
+	/* apply what a vanished client left pending */
+	if (pending.arrange)
+		arrange();
+	else if (pending.draw)
+		draw_all();
+}
+
+static void
+handle_cmdsock(void) {
+	CmdConn *conn;
+	int fd = accept(cmdsock.fd, NULL, NULL);
+
+	if (fd == -1)
+		return;
+	if (!(conn = calloc(1, sizeof(*conn)))) {
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	conn->fd = fd;
+	conn->fdin = conn->fdout = -1;
+	conn->next = cmdsock.conns;
+	cmdsock.conns = conn;
+}
+
+/* writes up to len bytes of pending output, passing the descriptor along */
+static ssize_t
+cmdconn_sendfd(CmdConn *conn, size_t len) {
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} cmsg = { 0 };
+	struct iovec iov = { .iov_base = conn->out.data, .iov_len = len };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cmsg.buf,
+		.msg_controllen = sizeof cmsg.buf,
+	};
+	cmsg.hdr.cmsg_level = SOL_SOCKET;
+	cmsg.hdr.cmsg_type = SCM_RIGHTS;
+	cmsg.hdr.cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(&cmsg.hdr), &conn->fdout, sizeof(int));
+	return sendmsg(conn->fd, &msg, 0);
+}
+
+/* returns false if the connection was closed */
+static bool
+cmdconn_flush(CmdConn *conn) {
+	while (conn->out.len) {
+		ssize_t len;
+		if (conn->fdout == -1)
+			len = write(conn->fd, conn->out.data, conn->out.len);
+		else if (conn->fdout_pos)
+			len = write(conn->fd, conn->out.data, conn->fdout_pos);
+		else
+			len = cmdconn_sendfd(conn, conn->out.len);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			cmdconn_close(conn);
+			return false;
+		}
+		register_consume(&conn->out, len);
+		if (conn->fdout != -1 && conn->fdout_pos) {
+			conn->fdout_pos -= len;
+		} else if (conn->fdout != -1) {
+			close(conn->fdout);
+			conn->fdout = -1;
+		}
+	}
+	if (conn->eof && !cmdconn_ready(conn)) {
+		cmdconn_close(conn);
+		return false;
+	}
+	return true;
+}
+
+/* whether a complete request frame is waiting to be executed */
+static bool
+cmdconn_ready(CmdConn *conn) {
+	const unsigned char *hdr = (unsigned char *)conn->in.data;
+
+	if (conn->in.len < 4)
+		return false;
+	uint32_t len = (uint32_t)hdr[0] << 24 | hdr[1] << 16 | hdr[2] << 8 | hdr[3];
+	return len > CMDSOCK_FRAME_MAX || conn->in.len >= 4 + len;
+}
+
+/* executes every complete request frame, each one is answered by exactly
+ * one response frame containing whatever the command returned. Returns
+ * false if the connection was closed. */
+static bool
+cmdconn_execute(CmdConn *conn) {
+	while (conn->in.len >= 4 && conn->out.len < CMDSOCK_QUEUE_MAX) {
+		const unsigned char *hdr = (unsigned char *)conn->in.data;
+		uint32_t len = (uint32_t)hdr[0] << 24 | hdr[1] << 16 | hdr[2] << 8 | hdr[3];
+		if (len > CMDSOCK_FRAME_MAX) {
+			cmdconn_close(conn);
+			return false;
 		}
+		if (conn->in.len < 4 + len)
+			break;
+
+		char *cmdbuf = malloc(len + 2);
+		size_t pos = conn->out.len;
+		if (!cmdbuf || !register_append(&conn->out, "\0\0\0\0", 4)) {
+			free(cmdbuf);
+			cmdconn_close(conn);
+			return false;
+		}
+		memcpy(cmdbuf, conn->in.data + 4, len);
+		register_consume(&conn->in, 4 + len);
+		/* handle_cmd only executes new line terminated commands */
+		if (!len || cmdbuf[len - 1] != '\n')
+			cmdbuf[len++] = '\n';
+		cmdbuf[len] = '\0';
+
+		conn->frame = pos;
+		cmdsock.current = conn;
+		handle_cmd(cmdbuf);
+		cmdsock.current = NULL;
+		free(cmdbuf);
+
+		unsigned char *out = (unsigned char *)conn->out.data + pos;
+		uint32_t retlen = conn->out.len - pos - 4;
+		out[0] = retlen >> 24;
+		out[1] = retlen >> 16;
+		out[2] = retlen >> 8;
+		out[3] = retlen;
 	}
+	return true;
 }
 
+/* keeps the last descriptor passed by the client for copybuf putfd */
 static void
-handle_cmdfifo(void) {
-	char *p, cmdbuf[512];
-	int r;
+cmdconn_recvfd(CmdConn *conn, struct msghdr *msg) {
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		int *fds = (int *)CMSG_DATA(cmsg);
+		size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (size_t i = 0; i < n; i++) {
+			if (conn->fdin != -1)
+				close(conn->fdin);
+			conn->fdin = fds[i];
+			fcntl(conn->fdin, F_SETFD, FD_CLOEXEC);
+		}
+	}
+}
 
-	r = read(cmdfifo.fd, cmdbuf, sizeof cmdbuf - 1);
-	if (r <= 0) {
-		cmdfifo.fd = -1;
-		return;
+/* reads at most one buffer, returns false if the connection was closed */
+static bool
+cmdconn_read(CmdConn *conn) {
+	char buf[4096];
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} cmsg;
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof buf };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	ssize_t len;
+
+	msg.msg_control = cmsg.buf;
+	msg.msg_controllen = sizeof cmsg.buf;
+	if ((len = recvmsg(conn->fd, &msg, 0)) > 0) {
+		cmdconn_recvfd(conn, &msg);
+		if (!register_append(&conn->in, buf, len)) {
+			cmdconn_close(conn);
+			return false;
+		}
+	} else if (len == 0) {
+		conn->eof = true;
+	} else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+		cmdconn_close(conn);
+		return false;
 	}
+	return true;
+}
 
-	cmdbuf[r] = '\0';
-	handle_cmd(cmdbuf);
+/* all requests received in one go are applied with a single arrange(),
+ * those left over from a previous pass are executed once there is room
+ * for their responses */
+static void
+handle_cmdconn(CmdConn *conn, bool readable) {
+	batch = &conn->batch;
+	batch_start();
+	if ((!readable || cmdconn_read(conn)) && cmdconn_execute(conn) && cmdconn_flush(conn))
+		batch_end();
+	batch = NULL;
 }
 
 static void docmd(const char *args[]) {
@@ -2230,6 +4236,7 @@ static void doexec(const char *args[]) {
 	}
 
 	sel->term = sel->overlay;
+	intmap_put(&client_pids, vt_pid_get(sel->overlay), sel);
 }
 
 static void doret(const char *msg, size_t len) {
@@ -2238,6 +4245,11 @@ static void doret(const char *msg, size_t len) {
     const char *ptr = msg;
     int i;
 
+    if (cmdsock.current) {
+	    register_append(&cmdsock.current->out, msg, len);
+	    return;
+    }
+
     if (retfifo.fd <= 0)
 	    return;
 
@@ -2259,6 +4271,9 @@ static void setstatus(const char *args[]) {
 			bar.align = BAR_LEFT;
 		else if (strcmp("right", args[1]) == 0)
 			bar.align = BAR_RIGHT;
+	} else if (strcmp("stats", args[0]) == 0) {
+		bar.stats = strcmp("on", args[1]) == 0;
+		drawbar();
 	}
 }
 
@@ -2323,28 +4338,61 @@ handle_statusbar(void) {
 	}
 }
 
+/* reads what the editor wrote so far, returns false once it is done */
+static bool
+handle_editor_output(Client *c) {
+	size_t avail;
+	char *buf = rope_space(&c->edited, &avail);
+	ssize_t len = buf ? read(c->editor_fds[1], buf, avail) : -1;
+
+	if (len == -1 && errno == EINTR)
+		return true;
+	if (len <= 0) {
+		close(c->editor_fds[1]);
+		c->editor_fds[1] = -1;
+		return false;
+	}
+	rope_commit(&c->edited, len);
+	return true;
+}
+
 static void
 handle_editor(Client *c) {
-	if (!copyreg.data && (copyreg.data = malloc(screen.history)))
-		copyreg.size = screen.history;
-	copyreg.len = 0;
-	while (c->editor_fds[1] != -1 && copyreg.len < copyreg.size) {
-		ssize_t len = read(c->editor_fds[1], copyreg.data + copyreg.len, copyreg.size - copyreg.len);
-		if (len == -1) {
-			if (errno == EINTR)
-				continue;
-			break;
-		}
-		if (len == 0)
-			break;
-		copyreg.len += len;
-		if (copyreg.len == copyreg.size) {
-			copyreg.size *= 2;
-			if (!(copyreg.data = realloc(copyreg.data, copyreg.size))) {
-				copyreg.size = 0;
-				copyreg.len = 0;
+	while (c->editor_fds[1] != -1 && handle_editor_output(c));
+	/* an aborted edit leaves the register history alone */
+	if (c->edited.len)
+		*copyreg_new(NULL) = c->edited;
+	else
+		rope_free(&c->edited);
+	c->edited = (Rope){ 0 };
+}
+
+static void
+reap_children(void) {
+	int status;
+	pid_t pid;
+
+	child_died = false;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) != 0) {
+		if (pid == -1) {
+			if (errno == ECHILD) {
+				/* no more child processes */
+				break;
 			}
+			eprint("waitpid: %s\n", strerror(errno));
+			break;
 		}
+
+		debug("child with pid %d died\n", pid);
+
+		Client *c = intmap_get(&client_pids, pid);
+		if (!c)
+			continue;
+		if (c->pid == pid)
+			c->died = true;
+		else if (c->overlay && vt_pid_get(c->overlay) == pid)
+			c->overlay_died = true;
 	}
 }
 
@@ -2356,12 +4404,15 @@ handle_overlay(Client *c) {
 	c->overlay_died = false;
 	c->is_editor = false;
 	c->editor_fds[1] = -1;
+	intmap_del(&client_pids, vt_pid_get(c->overlay), c);
 	vt_destroy(c->overlay);
 	c->overlay = NULL;
 	c->term = c->app;
 	vt_dirty(c->term);
-	draw_content(c);
-	wnoutrefresh(c->window);
+	if (c->window) {
+		draw_content(c);
+		wnoutrefresh(c->window);
+	}
 }
 
 static int
@@ -2391,11 +4442,450 @@ open_or_create_fifo(const char *name, const char **name_created) {
 	return __open_or_create_fifo(name, name_created, O_RDWR|O_NONBLOCK);
 }
 
+static int
+session_connect(const char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return fd;
+}
+
+static void
+session_conn_close(Session *sess, SessionConn *conn) {
+	for (SessionConn **c = &sess->conns; *c; c = &(*c)->next) {
+		if (*c == conn) {
+			*c = conn->next;
+			break;
+		}
+	}
+	close(conn->fd);
+	free(conn->in.data);
+	free(conn->out.data);
+	free(conn);
+}
+
+/* replaces whatever is queued for the client by the current screen, the
+ * leading CAN aborts an escape sequence cut short by a partial write */
+static bool
+session_snapshot(Session *sess, SessionConn *conn) {
+	char *buf;
+	size_t len = vt_screen_get(sess->screen, &buf);
+	conn->out.len = 0;
+	bool ok = len && register_append(&conn->out, "\030", 1) &&
+	          register_append(&conn->out, buf, len);
+	free(buf);
+	return ok;
+}
+
+static bool
+session_send(Session *sess, SessionConn *conn, const char *data, size_t len) {
+	if (conn->out.len + len > SESSION_QUEUE_MAX)
+		return session_snapshot(sess, conn);
+	return register_append(&conn->out, data, len);
+}
+
+/* returns false if the connection was closed */
+static bool
+session_conn_read(Session *sess, SessionConn *conn) {
+	char buf[BUFSIZ];
+	ssize_t len = read(conn->fd, buf, sizeof buf);
+
+	if (len < 0 && (errno == EINTR || errno == EAGAIN))
+		return true;
+	if (len <= 0 || !register_append(&conn->in, buf, len)) {
+		session_conn_close(sess, conn);
+		return false;
+	}
+	while (conn->in.len >= 5) {
+		const unsigned char *hdr = (unsigned char *)conn->in.data;
+		uint32_t size = (uint32_t)hdr[1] << 24 | hdr[2] << 16 | hdr[3] << 8 | hdr[4];
+		if (size > SESSION_FRAME_MAX) {
+			session_conn_close(sess, conn);
+			return false;
+		}
+		if (conn->in.len < 5 + size)
+			break;
+		const char *payload = conn->in.data + 5;
+		if (hdr[0] == SESSION_INPUT) {
+			if (!register_append(&sess->input, payload, size)) {
+				session_conn_close(sess, conn);
+				return false;
+			}
+		} else if (hdr[0] == SESSION_WINSIZE && size == 4) {
+			const unsigned char *p = (unsigned char *)payload;
+			struct winsize ws = {
+				.ws_row = p[0] << 8 | p[1],
+				.ws_col = p[2] << 8 | p[3],
+			};
+			if (ws.ws_row && ws.ws_col) {
+				vt_resize(sess->screen, ws.ws_row, ws.ws_col);
+				ioctl(sess->pty, TIOCSWINSZ, &ws);
+			}
+		}
+		register_consume(&conn->in, 5 + size);
+	}
+	return true;
+}
+
+/* returns false if the connection was closed */
+static bool
+session_conn_flush(Session *sess, SessionConn *conn) {
+	while (conn->out.len) {
+		ssize_t len = write(conn->fd, conn->out.data, conn->out.len);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			session_conn_close(sess, conn);
+			return false;
+		}
+		register_consume(&conn->out, len);
+	}
+	return true;
+}
+
+static void
+session_input_flush(Session *sess) {
+	while (sess->input.len) {
+		ssize_t len = write(sess->pty, sess->input.data, sess->input.len);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				sess->input.len = 0;
+			return;
+		}
+		register_consume(&sess->input, len);
+	}
+}
+
+/* runs dvtm with the given arguments on a new pseudo terminal and serves
+ * its screen to the clients connecting to the listening socket, until it
+ * exits */
+static void
+session_serve(Session *sess, char *argv[], struct winsize *ws) {
+	char *pts;
+	int fd;
+
+	setsid();
+	signal(SIGPIPE, SIG_IGN);
+	if ((fd = open("/dev/null", O_RDWR)) != -1) {
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO)
+			close(fd);
+	}
+	if ((sess->pty = posix_openpt(O_RDWR|O_NOCTTY)) == -1 || grantpt(sess->pty) == -1 ||
+	    unlockpt(sess->pty) == -1 || !(pts = ptsname(sess->pty)))
+		goto out;
+	fcntl(sess->pty, F_SETFD, FD_CLOEXEC);
+	fcntl(sess->pty, F_SETFL, O_NONBLOCK);
+
+	if ((sess->pid = fork()) == -1)
+		goto out;
+	if (sess->pid == 0) {
+		setsid();
+		if ((fd = open(pts, O_RDWR)) == -1)
+			_exit(EXIT_FAILURE);
+#ifdef TIOCSCTTY
+		ioctl(fd, TIOCSCTTY, 0);
+#endif
+		ioctl(fd, TIOCSWINSZ, ws);
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO)
+			close(fd);
+		signal(SIGPIPE, SIG_DFL);
+		execvp(argv[0], argv);
+		_exit(EXIT_FAILURE);
+	}
+
+	/* the mirror is a headless terminal, curses output goes nowhere */
+	setlocale(LC_CTYPE, "");
+	FILE *out = fopen("/dev/null", "w"), *in = fopen("/dev/null", "r");
+	if (!out || !in || !newterm(NULL, out, in))
+		goto out;
+	start_color();
+	vt_init();
+	if (!(sess->screen = vt_create(ws->ws_row, ws->ws_col, 0)))
+		goto out;
+
+	for (;;) {
+		fd_set rd, wr;
+		int nfds = MAX(sess->fd, sess->pty);
+
+		FD_ZERO(&rd);
+		FD_ZERO(&wr);
+		FD_SET(sess->fd, &rd);
+		FD_SET(sess->pty, &rd);
+		if (sess->input.len)
+			FD_SET(sess->pty, &wr);
+		for (SessionConn *c = sess->conns; c; c = c->next) {
+			/* stop taking input while dvtm does not keep up with it */
+			if (sess->input.len < SESSION_QUEUE_MAX)
+				FD_SET(c->fd, &rd);
+			if (c->out.len)
+				FD_SET(c->fd, &wr);
+			nfds = MAX(nfds, c->fd);
+		}
+
+		if (select(nfds + 1, &rd, &wr, NULL, NULL) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (FD_ISSET(sess->pty, &rd)) {
+			char buf[BUFSIZ];
+			ssize_t len = read(sess->pty, buf, sizeof buf);
+			if (!len || (len < 0 && errno != EINTR && errno != EAGAIN))
+				break; /* dvtm exited */
+			if (len > 0) {
+				vt_feed(sess->screen, buf, len);
+				for (SessionConn *c = sess->conns; c; c = c->next)
+					session_send(sess, c, buf, len);
+			}
+		}
+
+		if (FD_ISSET(sess->pty, &wr))
+			session_input_flush(sess);
+
+		if (FD_ISSET(sess->fd, &rd) && (fd = accept(sess->fd, NULL, NULL)) != -1) {
+			SessionConn *conn = calloc(1, sizeof(*conn));
+			if (conn) {
+				fcntl(fd, F_SETFL, O_NONBLOCK);
+				fcntl(fd, F_SETFD, FD_CLOEXEC);
+				conn->fd = fd;
+				conn->next = sess->conns;
+				sess->conns = conn;
+				if (!session_snapshot(sess, conn))
+					session_conn_close(sess, conn);
+			} else {
+				close(fd);
+			}
+		}
+
+		for (SessionConn *c = sess->conns, *next; c; c = next) {
+			next = c->next;
+			if (FD_ISSET(c->fd, &rd) && !session_conn_read(sess, c))
+				continue;
+			if (FD_ISSET(c->fd, &wr))
+				session_conn_flush(sess, c);
+		}
+	}
+out:
+	while (sess->conns)
+		session_conn_close(sess, sess->conns);
+	free(sess->input.data);
+	unlink(sess->file);
+	if (sess->pid > 0)
+		waitpid(sess->pid, NULL, 0);
+	_exit(EXIT_SUCCESS);
+}
+
+static bool
+session_frame(int fd, int type, const unsigned char *data, size_t len) {
+	unsigned char hdr[5] = { type, len >> 24, len >> 16, len >> 8, len };
+	struct iovec iov[2] = {
+		{ .iov_base = hdr, .iov_len = sizeof hdr },
+		{ .iov_base = (void *)data, .iov_len = len },
+	};
+	size_t total = sizeof hdr + len;
+
+	while (total) {
+		ssize_t n = writev(fd, iov, 2);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		total -= n;
+		for (int i = 0; i < 2; i++) {
+			size_t used = MIN((size_t)n, iov[i].iov_len);
+			iov[i].iov_base = (char *)iov[i].iov_base + used;
+			iov[i].iov_len -= used;
+			n -= used;
+		}
+	}
+	return true;
+}
+
+static bool
+session_winsize(int fd) {
+	struct winsize ws;
+	if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ws) == -1)
+		return true;
+	unsigned char size[4] = { ws.ws_row >> 8, ws.ws_row, ws.ws_col >> 8, ws.ws_col };
+	return session_frame(fd, SESSION_WINSIZE, size, sizeof size);
+}
+
+static volatile sig_atomic_t session_resized;
+
+static void
+session_sigwinch_handler(int sig) {
+	session_resized = 1;
+}
+
+/* forwards the terminal to the session until it ends or the detach key
+ * is pressed */
+static int
+session_client(int fd) {
+	struct termios tio, raw;
+	bool tty = tcgetattr(STDIN_FILENO, &tio) == 0, detached = false;
+	struct sigaction sa = { .sa_handler = session_sigwinch_handler };
+
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGWINCH, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	if (tty) {
+		raw = tio;
+		raw.c_iflag &= ~(IGNBRK|BRKINT|PARMRK|ISTRIP|INLCR|IGNCR|ICRNL|IXON);
+		raw.c_oflag &= ~OPOST;
+		raw.c_lflag &= ~(ECHO|ECHONL|ICANON|ISIG|IEXTEN);
+		raw.c_cflag &= ~(CSIZE|PARENB);
+		raw.c_cflag |= CS8;
+		raw.c_cc[VMIN] = 1;
+		raw.c_cc[VTIME] = 0;
+		tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+	}
+
+	for (bool running = session_winsize(fd); running; ) {
+		fd_set rd;
+		char buf[BUFSIZ];
+		ssize_t len;
+
+		if (session_resized) {
+			session_resized = 0;
+			if (!session_winsize(fd))
+				break;
+		}
+		FD_ZERO(&rd);
+		FD_SET(STDIN_FILENO, &rd);
+		FD_SET(fd, &rd);
+		if (select(fd + 1, &rd, NULL, NULL, NULL) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (FD_ISSET(STDIN_FILENO, &rd)) {
+			if ((len = read(STDIN_FILENO, buf, sizeof buf)) <= 0)
+				break;
+			char *key = memchr(buf, DETACH_KEY, len);
+			if (key) {
+				len = key - buf;
+				running = false;
+				detached = true;
+			}
+			if (len && !session_frame(fd, SESSION_INPUT, (unsigned char *)buf, len))
+				break;
+		}
+		if (running && FD_ISSET(fd, &rd)) {
+			if ((len = read(fd, buf, sizeof buf)) <= 0)
+				break; /* the session ended */
+			for (ssize_t pos = 0, n; pos < len; pos += n) {
+				if ((n = write(STDOUT_FILENO, buf + pos, len - pos)) < 0) {
+					if (errno != EINTR)
+						return EXIT_FAILURE;
+					n = 0;
+				}
+			}
+		}
+	}
+
+	if (detached) {
+		/* leave the modes the session might have set */
+		static const char reset[] = "\033[0m\033[r\033[?1000l\033[?2004l\033[?1l\033>"
+		                            "\033[?25h\033[?1049l";
+		write(STDOUT_FILENO, reset, sizeof reset - 1);
+	}
+	if (tty)
+		tcsetattr(STDIN_FILENO, TCSANOW, &tio);
+	if (detached)
+		puts("[detached]");
+	return EXIT_SUCCESS;
+}
+
+/* attaches to the session listening at path, if there is none it is
+ * created running dvtm with the arguments except argv[pos] and argv[pos+1] */
+static void
+session_attach(const char *path, int argc, char *argv[], int pos) {
+	const char *current = getenv("DVTM_SESSION");
+	char *file;
+	int fd;
+
+	if (current && (file = realpath(path, NULL))) {
+		if (!strcmp(current, file))
+			error("%s: already attached to this session\n", path);
+		free(file);
+	}
+
+	if ((fd = session_connect(path)) == -1) {
+		struct sockaddr_un addr = { .sun_family = AF_UNIX };
+		struct winsize ws = { .ws_row = 24, .ws_col = 80 };
+		Session sess = { .file = path, .pty = -1 };
+		mode_t mask;
+		int bound;
+
+		/* a socket nobody listens on is left over by a dead server */
+		if (errno == ECONNREFUSED)
+			unlink(path);
+		else if (errno != ENOENT)
+			error("%s: %s\n", path, strerror(errno));
+		if (strlen(path) >= sizeof(addr.sun_path))
+			error("%s: socket path too long\n", path);
+		strcpy(addr.sun_path, path);
+		if ((sess.fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+			error("%s: %s\n", path, strerror(errno));
+		/* only the owner may attach to the session */
+		mask = umask(077);
+		bound = bind(sess.fd, (struct sockaddr *)&addr, sizeof(addr));
+		umask(mask);
+		if (bound == -1 || listen(sess.fd, 8) == -1)
+			error("%s: %s\n", path, strerror(errno));
+		fcntl(sess.fd, F_SETFD, FD_CLOEXEC);
+		if ((file = realpath(path, NULL)))
+			setenv("DVTM_SESSION", file, 1);
+		free(file);
+
+		ioctl(STDIN_FILENO, TIOCGWINSZ, &ws);
+		for (int i = pos; i + 2 <= argc; i++)
+			argv[i] = argv[i + 2];
+
+		pid_t pid = fork();
+		if (pid == -1)
+			error("%s\n", strerror(errno));
+		if (pid == 0)
+			session_serve(&sess, argv, &ws);
+		close(sess.fd);
+		if ((fd = session_connect(path)) == -1)
+			error("%s: %s\n", path, strerror(errno));
+	}
+
+	exit(session_client(fd));
+}
+
 static void
 usage(void) {
 	cleanup();
 	eprint("usage: dvtm [-v] [-M] [-m mod] [-d delay] [-h lines] [-t title] "
-	       "[-s status-fifo] [-c cmd-fifo] [cmd...]\n");
+	       "[-s status-fifo] [-c cmd-fifo] [-S cmd-socket] [-a session] [cmd...]\n");
 	exit(EXIT_FAILURE);
 }
 
@@ -2494,6 +4984,7 @@ parse_args(int argc, char *argv[]) {
 				for (unsigned int b = 0; b < LENGTH(bindings); b++)
 					if (bindings[b].keys[0] == MOD)
 						bindings[b].keys[0] = *mod;
+				keyindex_free(&bindings_index);
 				break;
 			}
 			case 'd':
@@ -2545,6 +5036,14 @@ parse_args(int argc, char *argv[]) {
 				setenv("DVTM_RET_FIFO", fifo, 1);
 				break;
 			}
+			case 'S': {
+				const char *sock;
+				cmdsock_listen(argv[++arg]);
+				if (!(sock = realpath(argv[arg], NULL)))
+					error("%s\n", strerror(errno));
+				setenv("DVTM_CMD_SOCKET", sock, 1);
+				break;
+			}
 			case 'b':
 				addusrkeyb(argv[++arg]);
 				break;
@@ -2563,6 +5062,17 @@ main(int argc, char *argv[]) {
 	sigset_t emptyset, blockset;
 
 	setenv("DVTM", VERSION, 1);
+	/* sessions are attached to before anything touches the terminal, all
+	 * other arguments are meant for the dvtm running within the session */
+	for (int arg = 1; arg < argc; arg++) {
+		if (argv[arg][0] != '-' || argv[arg][1] == 'v' || argv[arg][1] == 'M')
+			continue;
+		if (arg + 1 >= argc)
+			usage();
+		if (argv[arg][1] == 'a')
+			session_attach(argv[arg + 1], argc, argv, arg);
+		arg++;
+	}
 	if (!parse_args(argc, argv)) {
 		setup();
 		startup(NULL);
@@ -2576,14 +5086,36 @@ main(int argc, char *argv[]) {
 
 	while (running) {
 		int r, nfds = 0;
-		fd_set rd;
+		fd_set rd, wr;
+		struct timespec timeout, *ptimeout = NULL;
+		uint64_t now = timestamp_ns(), next;
 
+		/* a burst of SIGWINCH is applied once it settles */
 		if (screen.need_resize) {
-			resize_screen();
 			screen.need_resize = false;
+			screen.resize_ns = now + RESIZE_DELAY * 1000000ULL;
+		}
+		if (screen.resize_ns && screen.resize_ns <= now) {
+			screen.resize_ns = 0;
+			resize_screen();
+		}
+
+		next = winsize_sync(now);
+		if (screen.resize_ns && (!next || screen.resize_ns < next))
+			next = screen.resize_ns;
+		if (next) {
+			timeout.tv_sec = (next - now) / 1000000000ULL;
+			timeout.tv_nsec = (next - now) % 1000000000ULL;
+			ptimeout = &timeout;
 		}
 
+		if (child_died)
+			reap_children();
+
+		evt_flush();
+
 		FD_ZERO(&rd);
+		FD_ZERO(&wr);
 		FD_SET(STDIN_FILENO, &rd);
 
 		if (cmdfifo.fd != -1) {
@@ -2596,6 +5128,25 @@ main(int argc, char *argv[]) {
 			nfds = MAX(nfds, bar.fd);
 		}
 
+		if (cmdsock.fd != -1) {
+			FD_SET(cmdsock.fd, &rd);
+			nfds = MAX(nfds, cmdsock.fd);
+		}
+
+		if (evtfifo.fd != -1 && evtfifo_sub.ring.len) {
+			FD_SET(evtfifo.fd, &wr);
+			nfds = MAX(nfds, evtfifo.fd);
+		}
+
+		for (CmdConn *conn = cmdsock.conns; conn; conn = conn->next) {
+			bool full = conn->out.len >= CMDSOCK_QUEUE_MAX;
+			if (!conn->eof && !full)
+				FD_SET(conn->fd, &rd);
+			if (conn->out.len || (!full && cmdconn_ready(conn)))
+				FD_SET(conn->fd, &wr);
+			nfds = MAX(nfds, conn->fd);
+		}
+
 		for (Client *c = clients; c; ) {
 			if (c->overlay && c->overlay_died)
 				handle_overlay(c);
@@ -2606,13 +5157,41 @@ main(int argc, char *argv[]) {
 				continue;
 			}
 			int pty = c->overlay ? vt_pty_get(c->overlay) : vt_pty_get(c->app);
-			FD_SET(pty, &rd);
-			nfds = MAX(nfds, pty);
+			if (c->overlay || !tap_throttled(c)) {
+				FD_SET(pty, &rd);
+				nfds = MAX(nfds, pty);
+			}
+			if (c->tap && c->tap->queue.len) {
+				FD_SET(c->tap->fd, &wr);
+				nfds = MAX(nfds, c->tap->fd);
+			}
+			if (c->is_editor && c->editor_fds[1] != -1) {
+				FD_SET(c->editor_fds[1], &rd);
+				nfds = MAX(nfds, c->editor_fds[1]);
+			}
+			if (vt_write_pending(c->app))
+				FD_SET(vt_pty_get(c->app), &wr);
+			if (c->overlay && vt_write_pending(c->overlay))
+				FD_SET(vt_pty_get(c->overlay), &wr);
+			nfds = MAX(nfds, vt_pty_get(c->app));
 			c = c->next;
 		}
 
+		for (Tap *tap = taps; tap; tap = tap->next) {
+			FD_SET(tap->fd, &wr);
+			nfds = MAX(nfds, tap->fd);
+		}
+
+		if (transfer.left && cpyfifo.fd != -1 && (!transfer.client ||
+		    vt_write_pending(transfer.client->app) < TRANSFER_QUEUE_MAX)) {
+			FD_SET(cpyfifo.fd, &rd);
+			nfds = MAX(nfds, cpyfifo.fd);
+		}
+
 		doupdate();
-		r = pselect(nfds + 1, &rd, NULL, NULL, NULL, &emptyset);
+		if (tracer.enabled)
+			trace_update();
+		r = pselect(nfds + 1, &rd, &wr, NULL, ptimeout, &emptyset);
 
 		if (r < 0) {
 			if (errno == EINTR)
@@ -2666,8 +5245,39 @@ rescan:
 		if (bar.fd != -1 && FD_ISSET(bar.fd, &rd))
 			handle_statusbar();
 
+		if (cmdsock.fd != -1 && FD_ISSET(cmdsock.fd, &rd))
+			handle_cmdsock();
+
+		if (evtfifo.fd != -1 && FD_ISSET(evtfifo.fd, &wr))
+			evtfifo_flush();
+
+		if (transfer.left && cpyfifo.fd != -1 && FD_ISSET(cpyfifo.fd, &rd))
+			handle_transfer();
+
+		for (CmdConn *conn = cmdsock.conns, *next; conn; conn = next) {
+			next = conn->next;
+			if (FD_ISSET(conn->fd, &rd))
+				handle_cmdconn(conn, true);
+			else if (FD_ISSET(conn->fd, &wr) || conn->eof)
+				handle_cmdconn(conn, false);
+		}
+
+		taps_flush(&wr);
+
 		for (Client *c = clients; c; c = c->next) {
+			if (c->tap && FD_ISSET(c->tap->fd, &wr))
+				tap_flush(c);
+
+			if (c->is_editor && c->editor_fds[1] != -1 && FD_ISSET(c->editor_fds[1], &rd))
+				handle_editor_output(c);
+
+			if (FD_ISSET(vt_pty_get(c->app), &wr))
+				vt_write_flush(c->app);
+			if (c->overlay && FD_ISSET(vt_pty_get(c->overlay), &wr))
+				vt_write_flush(c->overlay);
+
 			if (FD_ISSET(vt_pty_get(c->term), &rd)) {
+				uint64_t start = timestamp_ns();
 				if (vt_process(c->term) < 0 && errno == EIO) {
 					if (c->overlay)
 						c->overlay_died = true;
@@ -2675,6 +5285,19 @@ rescan:
 						c->died = true;
 					continue;
 				}
+				uint64_t end = timestamp_ns();
+				c->stats.process_ns += end - start;
+				if (c->stats.input_ns) {
+					uint64_t latency = end - c->stats.input_ns;
+					c->stats.latency_ns += latency;
+					c->stats.latency_max_ns = MAX(c->stats.latency_max_ns, latency);
+					c->stats.latency_count++;
+					c->stats.input_ns = 0;
+				}
+				if (c->stats.trace_key_ns && !c->stats.trace_read_ns) {
+					c->stats.trace_read_ns = end;
+					histogram_add(&tracer.read, end - c->stats.trace_key_ns);
+				}
 			}
 
 			if (is_content_visible(c)) {
@@ -2691,6 +5314,9 @@ rescan:
 			}
 		}
 
+		if (bar.stats)
+			drawbar();
+
 		if (is_content_visible(sel)) {
 			draw_content(sel);
 			curs_set(vt_cursor_visible(sel->term));
@@ -1,29 +1,22 @@
-static void fibonacci(int s)
+static void fibonacci(Rect *r, unsigned int n, float mfact, Rect a, int s)
 {
-	unsigned int nx, ny, nw, nnw, nh, nnh, i, n, mod;
-	Client *c;
-
-	for (n = 0, c = nextvisible(clients); c; c = nextvisible(c->next))
-		if (!c->minimized)
-			n++;
+	unsigned int nx, ny, nw, nnw, nh, nnh, i, mod;
 
 	/* initial position and dimensions */
-	nx = wax;
-	ny = way;
-	nw = (n == 1) ? waw : screen.mfact * waw;
+	nx = a.x;
+	ny = a.y;
+	nw = (n == 1) ? a.w : mfact * a.w;
 	/* don't waste space dviding by 2 doesn't work for odd numbers
 	 * plus we need space for the border too. therefore set up these
 	 * variables for the next new width/height
 	 */
-	nnw = waw - nw - 1;
-	nnh = nh = wah;
+	nnw = a.w - nw - 1;
+	nnh = nh = a.h;
 
 	/* set the mod factor, 2 for dwindle, 4 for spiral */
 	mod = s ? 4 : 2;
 
-	for (i = 0, c = nextvisible(clients); c; c = nextvisible(c->next)) {
-		if (c->minimized)
-			continue;
+	for (i = 0; i < n; i++) {
 		/* dwindle: even case, spiral: case 0 */
 		if (i % mod == 0) {
 			if (i) {
@@ -39,13 +32,9 @@ static void fibonacci(int s)
 					nw /= 2;
 					nnw -= nw + 1;
 				}
-				mvaddch(ny, nx - 1, ACS_LTEE);
 			}
 		} else if (i % mod == 1) {	/* dwindle: odd case, spiral: case 1 */
-			nx += nw;
-			mvvline(ny, nx, ACS_VLINE, nh);
-			mvaddch(ny, nx, ACS_TTEE);
-			++nx;
+			nx += nw + 1;	/* border */
 			nw = nnw;
 			/* don't adjust the height for the last client */
 			if (i < n - 1) {
@@ -59,12 +48,7 @@ static void fibonacci(int s)
 			if (i < n - 1) {
 				nw /= 2;
 				nnw -= nw + 1;
-				nx += nnw;
-				mvvline(ny, nx, ACS_VLINE, nh);
-				mvaddch(ny, nx, ACS_TTEE);
-				++nx;
-			} else {
-				mvaddch(ny, nx - 1, ACS_LTEE);
+				nx += nnw + 1;	/* border */
 			}
 		} else if (s) {	/* spiral: case 3 */
 			nw = nnw;
@@ -75,20 +59,18 @@ static void fibonacci(int s)
 				nnh -= nh;
 				ny += nnh;
 			}
-			mvaddch(ny, nx - 1, ACS_LTEE);
 		}
 
-		resize(c, nx, ny, nw, nh);
-		i++;
+		r[i] = (Rect){ nx, ny, nw, nh };
 	}
 }
 
-static void spiral(void)
+static void spiral(Rect *r, unsigned int n, unsigned int nmaster, float mfact, Rect a)
 {
-	fibonacci(1);
+	fibonacci(r, n, mfact, a, 1);
 }
 
-static void dwindle(void)
+static void dwindle(Rect *r, unsigned int n, unsigned int nmaster, float mfact, Rect a)
 {
-	fibonacci(0);
+	fibonacci(r, n, mfact, a, 0);
 }
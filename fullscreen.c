@@ -1,5 +1,5 @@
-static void fullscreen(void)
+static void fullscreen(Rect *r, unsigned int n, unsigned int nmaster, float mfact, Rect a)
 {
-	for (Client *c = nextvisible(clients); c; c = nextvisible(c->next))
-		resize(c, wax, way, waw, wah);
+	for (unsigned int i = 0; i < n; i++)
+		r[i] = a;
 }
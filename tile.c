@@ -1,49 +1,27 @@
-static void tile(void)
+static void tile(Rect *r, unsigned int n, unsigned int nmaster, float mfact, Rect a)
 {
-	unsigned int i, n, nx, ny, nw, nh, m, mw, mh, th;
-	Client *c;
+	unsigned int i, nx, ny, nw = 0, nh, m, mw, mh, th;
 
-	for (n = 0, c = nextvisible(clients); c; c = nextvisible(c->next))
-		if (!c->minimized)
-			n++;
+	m  = MAX(1, MIN(n, nmaster));
+	mw = n == m ? a.w : mfact * a.w;
+	mh = a.h / m;
+	th = n == m ? 0 : a.h / (n - m);
+	nx = a.x;
+	ny = a.y;
 
-	m  = MAX(1, MIN(n, getnmaster()));
-	mw = n == m ? waw : getmfact() * waw;
-	mh = wah / m;
-	th = n == m ? 0 : wah / (n - m);
-	nx = wax;
-	ny = way;
-
-	for (i = 0, c = nextvisible(clients); c; c = nextvisible(c->next)) {
-		if (c->minimized)
-			continue;
+	for (i = 0; i < n; i++) {
 		if (i < m) {	/* master */
 			nw = mw;
-			nh = (i < m - 1) ? mh : (way + wah) - ny;
+			nh = (i < m - 1) ? mh : (a.y + a.h) - ny;
 		} else {	/* tile window */
 			if (i == m) {
-				ny = way;
-				nx += mw;
-				mvvline(ny, nx, ACS_VLINE, wah);
-				mvaddch(ny, nx, ACS_TTEE);
-				nx++;
-				nw = waw - mw -1;
+				ny = a.y;
+				nx += mw + 1;	/* border */
+				nw = a.w - mw - 1;
 			}
-			nh = (i < n - 1) ? th : (way + wah) - ny;
-			if (i > m)
-				mvaddch(ny, nx - 1, ACS_LTEE);
+			nh = (i < n - 1) ? th : (a.y + a.h) - ny;
 		}
-		resize(c, nx, ny, nw, nh);
+		r[i] = (Rect){ nx, ny, nw, nh };
 		ny += nh;
-		i++;
-	}
-
-	/* Fill in nmaster intersections */
-	if (n > m) {
-		ny = way + mh;
-		for (i = 1; i < m; i++) {
-			mvaddch(ny, nx - 1, ((ny - 1) % th ? ACS_RTEE : ACS_PLUS));
-			ny += mh;
-		}
 	}
 }
@@ -1,45 +1,31 @@
-static void tstack(void)
+static void tstack(Rect *r, unsigned int n, unsigned int nmaster, float mfact, Rect a)
 {
-	unsigned int i, n, nx, ny, nw, nh, m, mw, mh, tw;
-	Client *c;
+	unsigned int i, nx, ny, nw, nh = 0, m, mw, mh, tw;
 
-	for (n = 0, c = nextvisible(clients); c; c = nextvisible(c->next))
-		if (!c->minimized)
-			n++;
+	m  = MAX(1, MIN(n, nmaster));
+	mh = n == m ? a.h : mfact * a.h;
+	mw = a.w / m;
+	tw = n == m ? 0 : a.w / (n - m);
+	nx = a.x;
+	ny = a.y + a.h - mh;
 
-	m  = MAX(1, MIN(n, screen.nmaster));
-	mh = n == m ? wah : screen.mfact * wah;
-	mw = waw / m;
-	tw = n == m ? 0 : waw / (n - m);
-	nx = wax;
-	ny = way + wah - mh;
-
-	for (i = 0, c = nextvisible(clients); c; c = nextvisible(c->next)) {
-		if (c->minimized)
-			continue;
+	for (i = 0; i < n; i++) {
 		if (i < m) {	/* master */
-			if (i > 0) {
-				mvvline(ny, nx, ACS_VLINE, nh);
-				mvaddch(ny, nx, ACS_TTEE);
-				nx++;
-			}
+			if (i > 0)
+				nx++;	/* border */
 			nh = mh;
-			nw = (i < m - 1) ? mw : (wax + waw) - nx;
+			nw = (i < m - 1) ? mw : (a.x + a.w) - nx;
 		} else {	/* tile window */
 			if (i == m) {
-				nx = wax;
-				ny = way;
-				nh = (way + wah) - ny - mh;
-			}
-			if (i > m) {
-				mvvline(ny, nx, ACS_VLINE, nh);
-				mvaddch(ny, nx, ACS_TTEE);
-				nx++;
+				nx = a.x;
+				ny = a.y;
+				nh = (a.y + a.h) - ny - mh;
 			}
-			nw = (i < n - 1) ? tw : (wax + waw) - nx;
+			if (i > m)
+				nx++;	/* border */
+			nw = (i < n - 1) ? tw : (a.x + a.w) - nx;
 		}
-		resize(c, nx, ny, nw, nh);
+		r[i] = (Rect){ nx, ny, nw, nh };
 		nx += nw;
-		i++;
 	}
 }
@@ -1,27 +1,19 @@
 /* A vertical stack layout, all windows have the full screen width. */
-static void vstack(void)
+static void vstack(Rect *r, unsigned int n, unsigned int nmaster, float mfact, Rect a)
 {
-	unsigned int i, n, ny, nh, m, mh, th;
-	Client *c;
+	unsigned int i, ny, nh, m, mh, th;
 
-	for (n = 0, c = nextvisible(clients); c; c = nextvisible(c->next))
-		if (!c->minimized)
-			n++;
+	m  = MAX(1, MIN(n, nmaster));
+	mh = (n == m ? a.h : mfact * a.h);
+	th = n == m ? 0 : (a.h - mh) / (n - m);
+	ny = a.y;
 
-	m  = MAX(1, MIN(n, screen.nmaster));
-	mh = (n == m ? wah : screen.mfact * wah);
-	th = n == m ? 0 : (wah - mh) / (n - m);
-	ny = way;
-
-	for (i = 0, c = nextvisible(clients); c; c = nextvisible(c->next)) {
-		if (c->minimized)
-			continue;
+	for (i = 0; i < n; i++) {
 		if (i < m) /* master */
-			nh = (i < m - 1) ? mh / m : (way + mh) - ny;
+			nh = (i < m - 1) ? mh / m : (a.y + mh) - ny;
 		else /* tile window */
-			nh = (i < n - 1) ? th : (way + wah) - ny;
-		resize(c, wax, ny, waw, nh);
+			nh = (i < n - 1) ? th : (a.y + a.h) - ny;
+		r[i] = (Rect){ a.x, ny, a.w, nh };
 		ny += nh;
-		i++;
 	}
 }
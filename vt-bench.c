@@ -0,0 +1,357 @@
+/* Micro benchmark for the terminal emulator.
+ *
+ * Feeds synthetic (or recorded) byte streams directly through the vt
+ * parser of a headless Vt, i.e. without a pty or child process, and
+ * measures parser throughput, allocations, the cost of vt_draw()
+ * into an off-screen curses pad, of widening the terminal and of
+ * creating and destroying a terminal.
+ *
+ * See LICENSE for details.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <langinfo.h>
+#include <wchar.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <termios.h>
+#include "vt.h"
+
+/* count the allocations done by the emulator itself */
+static size_t allocs, alloc_bytes;
+
+static void *bench_malloc(size_t size) {
+	allocs++;
+	alloc_bytes += size;
+	return malloc(size);
+}
+
+static void *bench_calloc(size_t nmemb, size_t size) {
+	allocs++;
+	alloc_bytes += nmemb * size;
+	return calloc(nmemb, size);
+}
+
+static void *bench_realloc(void *ptr, size_t size) {
+	allocs++;
+	alloc_bytes += size;
+	return realloc(ptr, size);
+}
+
+#define malloc bench_malloc
+#define calloc bench_calloc
+#define realloc bench_realloc
+#include "vt.c"
+#undef malloc
+#undef calloc
+#undef realloc
+
+typedef struct {
+	const char *name;
+	char *data;
+	size_t len;
+} Stream;
+
+typedef struct {
+	char *data;
+	size_t len, size;
+} Buf;
+
+static int rows = 24, cols = 80, history = 500;
+static size_t stream_size = 4 << 20;
+static uint32_t seed = 0x2545F491;
+
+static void die(const char *msg, ...) {
+	va_list ap;
+	va_start(ap, msg);
+	vfprintf(stderr, msg, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	exit(EXIT_FAILURE);
+}
+
+static uint32_t rnd(void) {
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static void buf_append(Buf *b, const char *data, size_t len) {
+	if (b->len + len > b->size) {
+		b->size = (b->len + len) * 2;
+		if (!(b->data = realloc(b->data, b->size)))
+			die("out of memory");
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+}
+
+static void buf_printf(Buf *b, const char *fmt, ...) {
+	char tmp[256];
+	va_list ap;
+	va_start(ap, fmt);
+	int len = vsnprintf(tmp, sizeof tmp, fmt, ap);
+	va_end(ap);
+	if (len > 0)
+		buf_append(b, tmp, MIN((size_t)len, sizeof(tmp) - 1));
+}
+
+static void gen_word(Buf *b) {
+	char word[16];
+	int len = 1 + rnd() % 10;
+	for (int i = 0; i < len; i++)
+		word[i] = 'a' + rnd() % 26;
+	buf_append(b, word, len);
+}
+
+static void gen_ascii(Buf *b) {
+	while (b->len < stream_size) {
+		int len = rnd() % cols;
+		for (int col = 0; col < len; col += 6) {
+			gen_word(b);
+			buf_append(b, " ", 1);
+		}
+		buf_append(b, "\r\n", 2);
+	}
+}
+
+static void gen_utf8(Buf *b) {
+	static const char *glyphs[] = {
+		"ä", "é", "ß", "ø", "λ", "Ω", "ж", "я",      /* narrow */
+		"日", "本", "語", "漢", "字", "한", "국", "中", /* wide */
+		"│", "─", "┼", "█",                          /* box drawing */
+	};
+	while (b->len < stream_size) {
+		int len = rnd() % cols;
+		for (int col = 0; col < len; col++) {
+			const char *g = glyphs[rnd() % LENGTH(glyphs)];
+			buf_append(b, g, strlen(g));
+		}
+		buf_append(b, "\r\n", 2);
+	}
+}
+
+static void gen_sgr(Buf *b) {
+	while (b->len < stream_size) {
+		int len = rnd() % cols;
+		for (int col = 0; col < len; col += 6) {
+			switch (rnd() % 4) {
+			case 0:
+				buf_printf(b, "\033[%dm", 30 + rnd() % 8);
+				break;
+			case 1:
+				buf_printf(b, "\033[1;38;5;%dm", rnd() % 256);
+				break;
+			case 2:
+				buf_printf(b, "\033[4;48;5;%d;38;5;%dm", rnd() % 256, rnd() % 256);
+				break;
+			case 3:
+				buf_printf(b, "\033[0m");
+				break;
+			}
+			gen_word(b);
+			buf_append(b, " ", 1);
+		}
+		buf_append(b, "\033[0m\r\n", 6);
+	}
+}
+
+/* full screen application redrawing its screen, in the style of top(1) */
+static void gen_tui(Buf *b) {
+	buf_append(b, "\033[?1049h\033[?25l", 14);
+	while (b->len < stream_size) {
+		buf_append(b, "\033[H", 3);
+		for (int row = 1; row <= rows; row++) {
+			buf_printf(b, "\033[%d;%dH", row, 1 + rnd() % 8);
+			if (row == 1)
+				buf_append(b, "\033[7m", 4);
+			for (int col = 0; col < cols / 2; col += 6) {
+				buf_printf(b, "\033[%dm", 30 + rnd() % 8);
+				gen_word(b);
+				buf_append(b, " ", 1);
+			}
+			buf_append(b, "\033[0m\033[K", 7);
+		}
+		if (rnd() % 8 == 0) {
+			/* scroll a region, as e.g. a pager would */
+			buf_printf(b, "\033[2;%dr\033[%d;1H\n\n\n\033[r", rows - 1, rows - 1);
+		}
+		if (rnd() % 32 == 0)
+			buf_append(b, "\033[2J", 4);
+	}
+	buf_append(b, "\033[?25h\033[?1049l", 14);
+}
+
+static void gen_scroll(Buf *b) {
+	while (b->len < stream_size) {
+		if (rnd() % 2)
+			buf_append(b, "\n", 1);
+		else
+			gen_word(b);
+		buf_append(b, "\r\n", 2);
+	}
+}
+
+static Stream generate(const char *name, void (*gen)(Buf*)) {
+	Buf b = { 0 };
+	gen(&b);
+	return (Stream){ .name = name, .data = b.data, .len = b.len };
+}
+
+static Stream load(const char *file) {
+	Buf b = { 0 };
+	char tmp[BUFSIZ];
+	ssize_t len;
+	int fd = open(file, O_RDONLY);
+	if (fd == -1)
+		die("can not open `%s': %s", file, strerror(errno));
+	while ((len = read(fd, tmp, sizeof tmp)) > 0)
+		buf_append(&b, tmp, len);
+	close(fd);
+	const char *name = strrchr(file, '/');
+	return (Stream){ .name = name ? name + 1 : file, .data = b.data, .len = b.len };
+}
+
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench(Stream *s, WINDOW *win) {
+	uint64_t start, parse_ns, draw_ns = 0, redraw_ns, resize_ns, create_ns, destroy_ns;
+	size_t draws = 0, parse_allocs, parse_bytes;
+	Vt *vt;
+
+	/* parser only, in read(2) sized chunks */
+	start = now();
+	if (!(vt = vt_create(rows, cols, history)))
+		die("vt_create failed");
+	create_ns = now() - start;
+	allocs = alloc_bytes = 0;
+	start = now();
+	for (size_t pos = 0; pos < s->len; pos += BUFSIZ)
+		vt_feed(vt, s->data + pos, MIN((size_t)BUFSIZ, s->len - pos));
+	parse_ns = now() - start;
+	parse_allocs = allocs;
+	parse_bytes = alloc_bytes;
+	/* with a filled scroll back buffer, as when closing a long lived pane */
+	start = now();
+	vt_destroy(vt);
+	destroy_ns = now() - start;
+
+	/* parser interleaved with drawing, as done by the main loop */
+	if (!(vt = vt_create(rows, cols, history)))
+		die("vt_create failed");
+	for (size_t pos = 0; pos < s->len; pos += BUFSIZ) {
+		vt_feed(vt, s->data + pos, MIN((size_t)BUFSIZ, s->len - pos));
+		start = now();
+		vt_draw(vt, win, 0, 0);
+		draw_ns += now() - start;
+		draws++;
+	}
+
+	/* repaint of the complete window */
+	start = now();
+	for (int i = 0; i < 100; i++) {
+		vt_dirty(vt);
+		vt_draw(vt, win, 0, 0);
+	}
+	redraw_ns = (now() - start) / 100;
+
+	/* widening beyond the allocated width, as when dragging a border */
+	start = now();
+	for (int i = 1; i <= 100; i++)
+		vt_resize(vt, rows, cols + i);
+	resize_ns = (now() - start) / 100;
+	vt_destroy(vt);
+
+	printf("%-12s %9zu %9.2f %8.2f %8zu %9zu %9.2f %9.2f %9.2f %9.2f %10.2f\n", s->name, s->len,
+	       (s->len / (1024.0 * 1024.0)) / (parse_ns / 1e9),
+	       (double)parse_ns / s->len, parse_allocs, parse_bytes / 1024,
+	       draws ? draw_ns / 1000.0 / draws : 0.0, redraw_ns / 1000.0, resize_ns / 1000.0,
+	       create_ns / 1000.0, destroy_ns / 1000.0);
+}
+
+static void usage(void) {
+	die("usage: vt-bench [-r rows] [-c cols] [-h history] [-s size-in-KiB] [file...]");
+}
+
+int main(int argc, char *argv[]) {
+	int arg;
+
+	for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++) {
+		if (arg + 1 >= argc)
+			usage();
+		switch (argv[arg][1]) {
+		case 'r':
+			rows = atoi(argv[++arg]);
+			break;
+		case 'c':
+			cols = atoi(argv[++arg]);
+			break;
+		case 'h':
+			history = atoi(argv[++arg]);
+			break;
+		case 's':
+			stream_size = (size_t)atoi(argv[++arg]) * 1024;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (rows <= 0 || cols <= 0 || history < 0 || !stream_size)
+		usage();
+
+	setlocale(LC_CTYPE, "");
+	if (strcmp(nl_langinfo(CODESET), "UTF-8") && !setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "en_US.UTF-8");
+
+	/* curses output goes nowhere, vt_draw() renders into a pad */
+	FILE *out = fopen("/dev/null", "w"), *in = fopen("/dev/null", "r");
+	if (!out || !in || !newterm("xterm-256color", out, in))
+		die("can not initialize curses");
+	start_color();
+	vt_init();
+	WINDOW *win = newpad(rows, cols);
+	if (!win)
+		die("can not create pad");
+
+	printf("%-12s %9s %9s %8s %8s %9s %9s %9s %9s %9s %10s\n", "stream", "bytes", "MB/s",
+	       "ns/byte", "allocs", "alloc-KiB", "draw-us", "redraw-us", "resize-us",
+	       "create-us", "destroy-us");
+
+	if (arg < argc) {
+		for (; arg < argc; arg++) {
+			Stream s = load(argv[arg]);
+			bench(&s, win);
+			free(s.data);
+		}
+	} else {
+		Stream streams[] = {
+			generate("ascii", gen_ascii),
+			generate("utf8", gen_utf8),
+			generate("sgr", gen_sgr),
+			generate("tui", gen_tui),
+			generate("scroll", gen_scroll),
+		};
+		for (unsigned int i = 0; i < LENGTH(streams); i++) {
+			bench(&streams[i], win);
+			free(streams[i].data);
+		}
+	}
+
+	delwin(win);
+	endwin();
+	vt_shutdown();
+	return 0;
+}
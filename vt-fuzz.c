@@ -0,0 +1,191 @@
+/* Fuzz target for the escape sequence parser.
+ *
+ * Arbitrary bytes are pushed through the parser of a headless Vt, the
+ * first bytes of every input select the terminal geometry. Besides
+ * memory errors (when built with sanitizers) inputs whose processing
+ * takes disproportionately long are reported as crashes, which catches
+ * hangs and superlinear parse times.
+ *
+ * Built with -DVT_FUZZ_LIBFUZZER the file provides the libFuzzer entry
+ * points, otherwise a standalone driver which runs every file given on
+ * the command line (or standard input, as used by AFL). With -g the
+ * driver instead checks that the per byte cost of each input does not
+ * grow when it is repeated many times.
+ *
+ * See LICENSE for details.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <langinfo.h>
+#include "vt.h"
+
+/* maximal tolerated parse time per input byte, generous enough for
+ * sanitizer builds. Only applied to inputs of at least VT_FUZZ_MIN_LEN
+ * bytes where timing is not dominated by setup costs. */
+#ifndef VT_FUZZ_NS_PER_BYTE
+#define VT_FUZZ_NS_PER_BYTE 50000
+#endif
+#define VT_FUZZ_MIN_LEN 1024
+/* the maximal tolerated growth of the per byte cost of an input when
+ * it is repeated VT_FUZZ_REPEAT times */
+#define VT_FUZZ_GROWTH 4.0
+#define VT_FUZZ_REPEAT 64
+
+static WINDOW *win;
+
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+	setlocale(LC_CTYPE, "");
+	if (strcmp(nl_langinfo(CODESET), "UTF-8") && !setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "en_US.UTF-8");
+	FILE *out = fopen("/dev/null", "w"), *in = fopen("/dev/null", "r");
+	if (!out || !in || !newterm("xterm-256color", out, in)) {
+		fprintf(stderr, "can not initialize curses\n");
+		exit(EXIT_FAILURE);
+	}
+	start_color();
+	vt_init();
+	win = newpad(256, 256);
+	return 0;
+}
+
+/* returns the time in ns spent processing the input */
+static uint64_t process(const uint8_t *data, size_t size, int repeat) {
+	int rows = 24, cols = 80, history = 100;
+	char *content = NULL;
+
+	if (size >= 3) {
+		rows = 1 + data[0] % 64;
+		cols = 1 + data[1] % 256;
+		history = data[2];
+		data += 3;
+		size -= 3;
+	}
+
+	Vt *vt = vt_create(rows, cols, history);
+	if (!vt)
+		abort();
+
+	uint64_t start = now();
+	for (int i = 0; i < repeat; i++) {
+		/* vary the chunk sizes to split multibyte characters and
+		 * escape sequences at arbitrary positions */
+		for (size_t pos = 0, chunk = 1; pos < size; pos += chunk, chunk = chunk * 7 % 4093 + 1)
+			vt_feed(vt, (const char *)data + pos, chunk < size - pos ? chunk : size - pos);
+	}
+	uint64_t elapsed = now() - start;
+
+	vt_draw(vt, win, 0, 0);
+	vt_scroll(vt, -rows);
+	vt_draw(vt, win, 0, 0);
+	vt_resize(vt, cols % 64 + 1, rows % 256 + 1);
+	vt_draw(vt, win, 0, 0);
+	vt_content_get(vt, &content, true);
+	free(content);
+	vt_region_get(vt, &content, -rows, 3 * rows, cols / 3, cols / 2, true);
+	free(content);
+	vt_screen_get(vt, &content);
+	free(content);
+	vt_destroy(vt);
+	return elapsed;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	uint64_t elapsed = process(data, size, 1);
+	if (size >= VT_FUZZ_MIN_LEN && elapsed / size > VT_FUZZ_NS_PER_BYTE) {
+		fprintf(stderr, "slow input: %zu bytes took %llu ns\n", size,
+		        (unsigned long long)elapsed);
+		abort();
+	}
+	return 0;
+}
+
+#ifndef VT_FUZZ_LIBFUZZER
+static uint8_t *load(const char *file, size_t *size) {
+	uint8_t *data = NULL;
+	size_t len = 0;
+	ssize_t r;
+	int fd = strcmp(file, "-") ? open(file, O_RDONLY) : STDIN_FILENO;
+	if (fd == -1)
+		return NULL;
+	do {
+		if (!(data = realloc(data, len + BUFSIZ)))
+			return NULL;
+		r = read(fd, data + len, BUFSIZ);
+		if (r > 0)
+			len += r;
+	} while (r > 0);
+	if (fd != STDIN_FILENO)
+		close(fd);
+	*size = len;
+	return data;
+}
+
+/* compares the per byte cost of a single pass over the input with the
+ * one of many passes over the same terminal state */
+static int guard(const char *file, const uint8_t *data, size_t size) {
+	if (size <= 3)
+		return 0;
+	uint64_t once = UINT64_MAX, many = UINT64_MAX;
+	/* best of a few runs to reduce timing noise */
+	for (int run = 0; run < 5; run++) {
+		uint64_t t = process(data, size, 1);
+		if (t < once)
+			once = t;
+		t = process(data, size, VT_FUZZ_REPEAT) / VT_FUZZ_REPEAT;
+		if (t < many)
+			many = t;
+	}
+	double growth = (double)many / (once ? once : 1);
+	bool slow = growth > VT_FUZZ_GROWTH && many - once > 100000;
+	printf("%-40s %8zu %10.1f %10.1f %6.2f%s\n", file, size,
+	       (double)once / size, (double)many / size, growth, slow ? " SLOW" : "");
+	return slow;
+}
+
+int main(int argc, char *argv[]) {
+	bool check_growth = false;
+	int arg = 1, failed = 0;
+
+	if (arg < argc && !strcmp(argv[arg], "-g")) {
+		check_growth = true;
+		arg++;
+	}
+
+	LLVMFuzzerInitialize(&argc, &argv);
+
+	if (check_growth)
+		printf("%-40s %8s %10s %10s %6s\n", "input", "bytes", "ns/byte", "ns/byte*n", "growth");
+
+	do {
+		const char *file = arg < argc ? argv[arg] : "-";
+		size_t size;
+		uint8_t *data = load(file, &size);
+		if (!data) {
+			fprintf(stderr, "can not read `%s'\n", file);
+			return EXIT_FAILURE;
+		}
+		if (check_growth)
+			failed |= guard(file, data, size);
+		else
+			LLVMFuzzerTestOneInput(data, size);
+		free(data);
+	} while (++arg < argc);
+
+	delwin(win);
+	endwin();
+	vt_shutdown();
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif /* VT_FUZZ_LIBFUZZER */
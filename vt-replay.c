@@ -0,0 +1,404 @@
+/* Replay a recorded terminal session into a headless terminal emulator.
+ *
+ * The captured output of a pty session is fed through the vt parser of
+ * a Vt which is not attached to any child process. Afterwards the
+ * resulting screen and scroll back content is written to standard
+ * output in a canonical textual form which is suitable for golden
+ * tests of the escape sequence parser:
+ *
+ *   size <rows> <cols>
+ *   cursor <row> <col> <visible|hidden>
+ *   buffer <normal|alternate>
+ *   title <title>
+ *   scrollback <lines>
+ *   <index>|<text>
+ *   ~ <first-col>-<last-col> <attributes> <fg> <bg>
+ *
+ * Scroll back rows have negative indices, screen rows start at 0.
+ * Trailing blanks of a row are omitted. Style lines (only printed when
+ * requested with -a) describe runs of cells whose attributes or colors
+ * differ from the defaults, attributes are given as a combination of
+ * b(old), d(im), i(talic), u(nderline), k (blink), r(everse), x (invisible).
+ *
+ * Input can be raw pty output, a script(1) typescript or an asciicast
+ * version 2 file as recorded by asciinema, whose resize events are
+ * applied as well. The format is detected automatically unless
+ * specified with -f. The transcripts in replay-tests/ are compared
+ * against their expected dumps by `make replay'.
+ *
+ * See LICENSE for details.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <locale.h>
+#include "vt.c"
+
+enum { FORMAT_AUTO, FORMAT_RAW, FORMAT_SCRIPT, FORMAT_CAST };
+
+typedef struct {
+	char *data;
+	size_t len, size;
+} Buf;
+
+static char title[256];
+
+static void die(const char *msg, ...) {
+	va_list ap;
+	va_start(ap, msg);
+	vfprintf(stderr, msg, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	exit(EXIT_FAILURE);
+}
+
+static void buf_append(Buf *b, const char *data, size_t len) {
+	if (b->len + len + 1 > b->size) {
+		b->size = (b->len + len + 1) * 2;
+		if (!(b->data = realloc(b->data, b->size)))
+			die("out of memory");
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+	b->data[b->len] = '\0';
+}
+
+static Buf load(const char *file) {
+	Buf b = { 0 };
+	char tmp[BUFSIZ];
+	ssize_t len;
+	int fd = strcmp(file, "-") ? open(file, O_RDONLY) : STDIN_FILENO;
+	if (fd == -1)
+		die("can not open `%s': %s", file, strerror(errno));
+	while ((len = read(fd, tmp, sizeof tmp)) > 0)
+		buf_append(&b, tmp, len);
+	if (len < 0)
+		die("can not read `%s': %s", file, strerror(errno));
+	if (fd != STDIN_FILENO)
+		close(fd);
+	buf_append(&b, "", 0);
+	return b;
+}
+
+static int detect(Buf *b) {
+	if (!strncmp(b->data, "Script started on ", 18))
+		return FORMAT_SCRIPT;
+	if (b->data[0] == '{') {
+		char *eol = strchr(b->data, '\n');
+		char *version = strstr(b->data, "\"version\"");
+		if (version && (!eol || version < eol))
+			return FORMAT_CAST;
+	}
+	return FORMAT_RAW;
+}
+
+/* strip the header and trailer lines written by script(1) */
+static void script_replay(Vt *vt, Buf *b) {
+	char *start = strchr(b->data, '\n'), *end = b->data + b->len;
+	if (!start)
+		return;
+	start++;
+	for (char *p = start; (p = strstr(p, "\nScript done on ")); p++)
+		end = p;
+	vt_feed(vt, start, end - start);
+}
+
+static int cast_header(Buf *b, const char *key) {
+	char *eol = strchr(b->data, '\n');
+	char *value = strstr(b->data, key);
+	if (!value || (eol && value > eol))
+		return 0;
+	value += strlen(key);
+	while (*value == ' ' || *value == ':')
+		value++;
+	return atoi(value);
+}
+
+static void utf8_append(Buf *b, unsigned long cp) {
+	char tmp[4];
+	size_t len;
+	if (cp < 0x80) {
+		tmp[0] = cp;
+		len = 1;
+	} else if (cp < 0x800) {
+		tmp[0] = 0xc0 | (cp >> 6);
+		tmp[1] = 0x80 | (cp & 0x3f);
+		len = 2;
+	} else if (cp < 0x10000) {
+		tmp[0] = 0xe0 | (cp >> 12);
+		tmp[1] = 0x80 | ((cp >> 6) & 0x3f);
+		tmp[2] = 0x80 | (cp & 0x3f);
+		len = 3;
+	} else {
+		tmp[0] = 0xf0 | (cp >> 18);
+		tmp[1] = 0x80 | ((cp >> 12) & 0x3f);
+		tmp[2] = 0x80 | ((cp >> 6) & 0x3f);
+		tmp[3] = 0x80 | (cp & 0x3f);
+		len = 4;
+	}
+	buf_append(b, tmp, len);
+}
+
+/* decode the JSON string starting after the opening quote at s,
+ * returns a pointer past the closing quote */
+static char *json_string(char *s, Buf *out) {
+	unsigned long surrogate = 0;
+	out->len = 0;
+	buf_append(out, "", 0);
+	for (; *s && *s != '"'; s++) {
+		if (*s != '\\') {
+			buf_append(out, s, 1);
+			continue;
+		}
+		switch (*++s) {
+		case 'b': buf_append(out, "\b", 1); break;
+		case 'f': buf_append(out, "\f", 1); break;
+		case 'n': buf_append(out, "\n", 1); break;
+		case 'r': buf_append(out, "\r", 1); break;
+		case 't': buf_append(out, "\t", 1); break;
+		case 'u': {
+			char hex[5] = { 0 };
+			for (int i = 0; i < 4 && s[1]; i++)
+				hex[i] = *++s;
+			unsigned long cp = strtoul(hex, NULL, 16);
+			if (cp >= 0xd800 && cp < 0xdc00) {
+				surrogate = cp;
+				continue;
+			}
+			if (cp >= 0xdc00 && cp < 0xe000 && surrogate)
+				cp = 0x10000 + ((surrogate - 0xd800) << 10) + (cp - 0xdc00);
+			utf8_append(out, cp);
+			break;
+		}
+		case '\0':
+			return s;
+		default:
+			buf_append(out, s, 1);
+			break;
+		}
+		surrogate = 0;
+	}
+	return *s ? s + 1 : s;
+}
+
+/* asciicast v2: a header line followed by [time, type, data] events */
+static void cast_replay(Vt *vt, Buf *b) {
+	Buf data = { 0 }, type = { 0 };
+	char *line = strchr(b->data, '\n');
+
+	while (line && *++line) {
+		char *s = line;
+		line = strchr(line, '\n');
+		if (*s != '[')
+			continue;
+		if (!(s = strchr(s, '"')))
+			break;
+		s = json_string(s + 1, &type);
+		if (!(s = strchr(s, '"')))
+			break;
+		s = json_string(s + 1, &data);
+		if (!strcmp(type.data, "o")) {
+			vt_feed(vt, data.data, data.len);
+		} else if (!strcmp(type.data, "r")) {
+			int cols, rows;
+			if (sscanf(data.data, "%dx%d", &cols, &rows) == 2)
+				vt_resize(vt, rows, cols);
+		}
+		if (line && s > line)
+			line = strchr(s, '\n');
+	}
+
+	free(data.data);
+	free(type.data);
+}
+
+static void title_handler(Vt *vt, const char *t) {
+	snprintf(title, sizeof title, "%s", t ? t : "");
+}
+
+static void dump_style(Buffer *b, Row *row) {
+	static const struct {
+		attr_t attr;
+		char flag;
+	} flags[] = {
+		{ A_BOLD, 'b' },
+		{ A_DIM, 'd' },
+#ifdef A_ITALIC
+		{ A_ITALIC, 'i' },
+#endif
+		{ A_UNDERLINE, 'u' },
+		{ A_BLINK, 'k' },
+		{ A_REVERSE, 'r' },
+		{ A_INVIS, 'x' },
+	};
+
+	/* scroll back rows keep their width, cells past it are blank */
+	int cols = MIN(b->cols, row->size);
+
+	for (int col = 0; col < cols; ) {
+		Cell *cell = row->cells + col;
+		attr_t attr = cell->attr << NCURSES_ATTR_SHIFT;
+		int end = col + 1;
+		while (end < cols && row->cells[end].attr == cell->attr &&
+		       row->cells[end].fg == cell->fg && row->cells[end].bg == cell->bg)
+			end++;
+		if ((attr & ~A_COLOR) != A_NORMAL || cell->fg != -1 || cell->bg != -1) {
+			char attrs[LENGTH(flags) + 1], *s = attrs;
+			for (unsigned int i = 0; i < LENGTH(flags); i++) {
+				if (attr & flags[i].attr)
+					*s++ = flags[i].flag;
+			}
+			if (s == attrs)
+				*s++ = '-';
+			*s = '\0';
+			printf("~ %d-%d %s %d %d\n", col, end - 1, attrs, cell->fg, cell->bg);
+		}
+		col = end;
+	}
+}
+
+static void dump_row(Buffer *b, Row *row, int index, bool style) {
+	char text[MB_LEN_MAX];
+	mbstate_t ps;
+	memset(&ps, 0, sizeof(ps));
+	int end = MIN(b->cols, row->size);
+
+	while (end > 0 && (row->cells[end-1].text == L'\0' || row->cells[end-1].text == L' '))
+		end--;
+
+	printf("%d|", index);
+	for (int col = 0; col < end; col++) {
+		wchar_t wc = row->cells[col].text;
+		if (wc == L'\0') {
+			putchar(' ');
+			continue;
+		}
+		size_t len = wcrtomb(text, wc, &ps);
+		if (len == (size_t)-1) {
+			putchar('?');
+			memset(&ps, 0, sizeof(ps));
+			continue;
+		}
+		fwrite(text, len, 1, stdout);
+		if (wcwidth(wc) > 1)
+			col++;
+	}
+	putchar('\n');
+	if (style)
+		dump_style(b, row);
+}
+
+static void dump(Vt *vt, bool style, bool scrollback) {
+	Buffer *b = vt->buffer;
+	int index = 0;
+
+	vt_noscroll(vt);
+	printf("size %d %d\n", b->rows, b->cols);
+	printf("cursor %d %d %s\n", (int)(b->curs_row - b->lines), b->curs_col,
+	       vt_cursor_visible(vt) ? "visible" : "hidden");
+	printf("buffer %s\n", b == &vt->buffer_normal ? "normal" : "alternate");
+	printf("title %s\n", title);
+	printf("scrollback %d\n", scrollback ? b->scroll_above : 0);
+
+	Row *row = scrollback ? buffer_row_first(b) : b->lines;
+	if (scrollback)
+		index = -b->scroll_above;
+	for (; row; row = buffer_row_next(b, row))
+		dump_row(b, row, index++, style);
+}
+
+static void usage(void) {
+	die("usage: vt-replay [-a] [-n] [-f raw|script|cast] [-r rows] [-c cols] [-h history] [file|-]");
+}
+
+int main(int argc, char *argv[]) {
+	int rows = 0, cols = 0, history = 1000, format = FORMAT_AUTO;
+	bool style = false, scrollback = true;
+	const char *file = "-";
+	int arg;
+
+	for (arg = 1; arg < argc && argv[arg][0] == '-' && argv[arg][1]; arg++) {
+		switch (argv[arg][1]) {
+		case 'a':
+			style = true;
+			continue;
+		case 'n':
+			scrollback = false;
+			continue;
+		}
+		if (arg + 1 >= argc)
+			usage();
+		switch (argv[arg][1]) {
+		case 'f':
+			arg++;
+			if (!strcmp(argv[arg], "raw"))
+				format = FORMAT_RAW;
+			else if (!strcmp(argv[arg], "script"))
+				format = FORMAT_SCRIPT;
+			else if (!strcmp(argv[arg], "cast"))
+				format = FORMAT_CAST;
+			else
+				usage();
+			break;
+		case 'r':
+			rows = atoi(argv[++arg]);
+			break;
+		case 'c':
+			cols = atoi(argv[++arg]);
+			break;
+		case 'h':
+			history = atoi(argv[++arg]);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (arg < argc)
+		file = argv[arg++];
+	if (arg < argc)
+		usage();
+
+	/* the dump has to be independent of the environment */
+	if (!setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "en_US.UTF-8");
+	is_utf8_locale();
+
+	Buf input = load(file);
+	if (format == FORMAT_AUTO)
+		format = detect(&input);
+	if (format == FORMAT_CAST) {
+		if (!rows)
+			rows = cast_header(&input, "\"height\"");
+		if (!cols)
+			cols = cast_header(&input, "\"width\"");
+	}
+	if (rows <= 0)
+		rows = 24;
+	if (cols <= 0)
+		cols = 80;
+
+	Vt *vt = vt_create(rows, cols, history);
+	if (!vt)
+		die("vt_create failed");
+	vt_title_handler_set(vt, title_handler);
+
+	switch (format) {
+	case FORMAT_SCRIPT:
+		script_replay(vt, &input);
+		break;
+	case FORMAT_CAST:
+		cast_replay(vt, &input);
+		break;
+	default:
+		vt_feed(vt, input.data, input.len);
+		break;
+	}
+
+	dump(vt, style, scrollback);
+	vt_destroy(vt);
+	free(input.data);
+	return 0;
+}
@@ -80,13 +80,17 @@
 #endif
 
 #define IS_CONTROL(ch) !((ch) & 0xffffff60UL)
+#define CSI_PARAM_MAX 65535
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define LENGTH(arr) (sizeof(arr) / sizeof((arr)[0]))
 
 static bool is_utf8, has_default_colors;
 static short color_pairs_reserved, color_pairs_max, color_pair_current;
 static short *color2palette, default_fg, default_bg;
 static char vt_term[32];
+static size_t history_budget, history_mem;
+static uint64_t history_seq;
 
 typedef struct {
 	wchar_t text;
@@ -95,8 +99,30 @@ typedef struct {
 	short bg;
 } Cell;
 
+/* Cells of rows are carved out of slabs holding SLAB_ROWS rows of the same
+ * width. Returned rows are handed out again, a slab is freed as soon as
+ * none of its rows is in use. The slabs of a buffer form a ring whose head
+ * is tried first. */
+#define SLAB_ROWS 32
+
+typedef struct Slab Slab;
+struct Slab {
+	Slab *prev, *next;
+	int cols;              /* width of the rows */
+	int used;              /* rows currently handed out */
+	int fresh;             /* rows never handed out, at the end of cells */
+	Cell *free;            /* returned rows, linked through their first cell */
+	Cell cells[];
+};
+
 typedef struct {
 	Cell *cells;
+	Slab *slab;            /* slab the cells belong to */
+	int size;              /* allocated cells, rows of the scroll back buffer
+	                        * are only widened once they are scrolled into view */
+	int wrap;              /* columns used before the text continued on the
+	                        * next row due to auto wrap, 0 if it did not */
+	uint64_t seq;          /* when the row entered the scroll back buffer */
 	unsigned dirty:1;
 } Row;
 
@@ -106,7 +132,9 @@ typedef struct {
  * If new content is added to terminal the view port slides down and the
  * previously top most line is moved into the scroll back buffer at postion
  * scroll_index. This index will eventually wrap around and thus overwrite
- * the oldest lines.
+ * the oldest lines. Until then only the first 'scroll_alloc' rows of the
+ * ring exist, they are grown in chunks as lines are pushed out of the
+ * viewport.
  *
  * In the scenerio below a scroll up has been performed. That is 'scroll_above'
  * lines still lie above the current view port. Further scrolling up will show
@@ -144,8 +172,12 @@ typedef struct {
  *          roll_buf + scroll_size->+----------------+-----+
  *                                   <-    maxcols       ->
  *                                   <-    cols    ->
+ *
+ * The cells held by the scroll back buffers of all terminals are limited
+ * to history_budget bytes, beyond it the oldest lines of any buffer are
+ * dropped first.
  */
-typedef struct {
+typedef struct Buffer {
 	Row *lines;            /* array of Row pointers of size 'rows' */
 	Row *curs_row;         /* row on which the cursor currently resides */
 	Row *scroll_buf;       /* a ring buffer holding the scroll back content */
@@ -153,11 +185,17 @@ typedef struct {
 	Row *scroll_bot;       /* row in lines where scrolling region ends */
 	bool *tabs;            /* a boolean flag for each column whether it is a tab */
 	int scroll_size;       /* maximal capacity of scroll back buffer (in lines) */
+	int scroll_alloc;      /* allocated rows of the scroll back buffer */
 	int scroll_index;      /* current index into the ring buffer */
 	int scroll_above;      /* number of lines above current viewport */
 	int scroll_below;      /* number of lines below current viewport */
+	size_t scroll_mem;     /* bytes of cells held by the scroll back buffer */
+	unsigned long long scroll_evicted; /* lines dropped to fit the budget */
+	struct Buffer *scroll_prev, *scroll_next; /* in the list of all buffers
+	                        * with a scroll back buffer */
 	int rows, cols;        /* current dimension of buffer */
 	int maxcols;           /* allocated cells (maximal cols over time) */
+	Slab *slabs;           /* storage of the cells of all rows */
 	attr_t curattrs, savattrs; /* current and saved attributes for cells */
 	int curs_col;          /* current cursor column (zero based) */
 	int curs_srow, curs_scol; /* saved cursor row/colmn (zero based) */
@@ -165,6 +203,8 @@ typedef struct {
 	short savfg, savbg;    /* saved colors */
 } Buffer;
 
+static Buffer *history_buffers;
+
 struct Vt {
 	Buffer buffer_normal;    /* normal screen buffer */
 	Buffer buffer_alternate; /* alternate screen buffer */
@@ -182,18 +222,25 @@ struct Vt {
 	unsigned bell:1;
 	unsigned relposmode:1;
 	unsigned mousetrack:1;
+	unsigned bracketpaste:1;
 	unsigned graphmode:1;
 	unsigned savgraphmode:1;
 	bool charsets[2];
+	wchar_t lastwc;          /* last printed character, repeated by REP */
 	/* buffers and parsing state */
 	char rbuf[BUFSIZ];
 	char ebuf[BUFSIZ];
 	unsigned int rlen, elen;
+	int ws_rows, ws_cols;    /* size last announced to the application */
+	char *wbuf;              /* data queued for the pty, valid in [wstart, wlen) */
+	size_t wstart, wlen, wsize;
 	int srow, scol;          /* last known offset to display start row, start column */
 	char title[256];         /* xterm style window title */
 	vt_title_handler_t title_handler; /* hook which is called when title changes */
 	vt_urgent_handler_t urgent_handler; /* hook which is called upon bell */
+	vt_tap_handler_t tap_handler; /* hook which is called with all bytes read */
 	void *data;              /* user supplied data */
+	VtStats stats;           /* counters for performance analysis */
 };
 
 static const char *keytable[KEY_MAX+1] = {
@@ -273,9 +320,105 @@ static void row_set(Row *row, int start, int len, Buffer *t)
 
 	for (int i = start; i < len + start; i++)
 		row->cells[i] = cell;
+	if (start == 0)
+		row->wrap = 0;
 	row->dirty = true;
 }
 
+static void slab_link(Buffer *b, Slab *s)
+{
+	if (b->slabs) {
+		s->next = b->slabs;
+		s->prev = b->slabs->prev;
+		s->prev->next = s;
+		s->next->prev = s;
+	} else {
+		s->next = s->prev = s;
+	}
+	b->slabs = s;
+}
+
+static void slab_unlink(Buffer *b, Slab *s)
+{
+	if (s->next == s) {
+		b->slabs = NULL;
+		return;
+	}
+	s->prev->next = s->next;
+	s->next->prev = s->prev;
+	if (b->slabs == s)
+		b->slabs = s->next;
+}
+
+static bool slab_usable(Slab *s, int cols)
+{
+	return s && s->cols == cols && (s->free || s->fresh);
+}
+
+static Cell *slab_alloc(Buffer *b, int cols, Slab **slab)
+{
+	Slab *s = b->slabs;
+	Cell *cells;
+
+	if (!slab_usable(s, cols) && s) {
+		/* rotate the exhausted head to the back of the ring */
+		b->slabs = s->next;
+		s = b->slabs;
+	}
+	if (!slab_usable(s, cols)) {
+		if (!(s = malloc(sizeof(*s) + sizeof(Cell) * cols * SLAB_ROWS)))
+			return NULL;
+		s->cols = cols;
+		s->used = 0;
+		s->fresh = SLAB_ROWS;
+		s->free = NULL;
+		slab_link(b, s);
+	}
+
+	if (s->free) {
+		cells = s->free;
+		memcpy(&s->free, cells, sizeof(s->free));
+	} else {
+		cells = s->cells + (SLAB_ROWS - s->fresh--) * cols;
+	}
+	s->used++;
+	*slab = s;
+	return cells;
+}
+
+static void slab_free(Buffer *b, Slab *s, Cell *cells)
+{
+	if (!s)
+		return;
+	slab_unlink(b, s);
+	if (--s->used == 0) {
+		free(s);
+		return;
+	}
+	memcpy(cells, &s->free, sizeof(s->free));
+	s->free = cells;
+	/* hand out its rows next */
+	slab_link(b, s);
+}
+
+/* makes room for at least cols cells, new ones are blank */
+static void row_fit(Buffer *b, Row *row, int cols)
+{
+	Slab *slab;
+	Cell *cells;
+
+	if (row->size >= cols || !(cells = slab_alloc(b, cols, &slab)))
+		return;
+	if (row->size)
+		memcpy(cells, row->cells, sizeof(Cell) * row->size);
+	int size = row->size;
+	slab_free(b, row->slab, row->cells);
+	row->cells = cells;
+	row->slab = slab;
+	row->size = cols;
+	row_set(row, size, cols - size, NULL);
+}
+
 static void row_roll(Row *start, Row *end, int count)
 {
 	int n = end - start;
@@ -314,15 +457,120 @@ static void buffer_clear(Buffer *b)
 
 static void buffer_free(Buffer *b)
 {
-	for (int i = 0; i < b->rows; i++)
-		free(b->lines[i].cells);
+	/* scroll_size may have dropped to 0 since the buffer was linked */
+	if (b->scroll_prev || history_buffers == b) {
+		if (b->scroll_prev)
+			b->scroll_prev->scroll_next = b->scroll_next;
+		else
+			history_buffers = b->scroll_next;
+		if (b->scroll_next)
+			b->scroll_next->scroll_prev = b->scroll_prev;
+		history_mem -= b->scroll_mem;
+	}
+	while (b->slabs) {
+		Slab *s = b->slabs;
+		slab_unlink(b, s);
+		free(s);
+	}
 	free(b->lines);
-	for (int i = 0; i < b->scroll_size; i++)
-		free(b->scroll_buf[i].cells);
 	free(b->scroll_buf);
 	free(b->tabs);
 }
 
+/* minimal growth of the scroll back buffer (in lines) */
+#define SCROLL_CHUNK 64
+
+/* makes room for at least n rows in the scroll back buffer, as long as the
+ * ring did not yet wrap around its allocated rows are contiguous */
+static void buffer_scroll_grow(Buffer *b, int n)
+{
+	int alloc = MAX(MAX(n, 2 * b->scroll_alloc), SCROLL_CHUNK);
+	if (alloc > b->scroll_size)
+		alloc = b->scroll_size;
+	Row *buf = realloc(b->scroll_buf, sizeof(Row) * alloc);
+	if (!buf) {
+		/* make do with what we have */
+		b->scroll_size = b->scroll_alloc;
+		if (b->scroll_above > b->scroll_size)
+			b->scroll_above = b->scroll_size;
+		if (b->scroll_index == b->scroll_size)
+			b->scroll_index = 0;
+		return;
+	}
+	memset(buf + b->scroll_alloc, 0, sizeof(Row) * (alloc - b->scroll_alloc));
+	b->scroll_buf = buf;
+	b->scroll_alloc = alloc;
+}
+
+/* drops the scroll back content and releases its memory */
+static void buffer_scroll_clear(Buffer *b)
+{
+	for (int i = 0; i < b->scroll_alloc; i++)
+		slab_free(b, b->scroll_buf[i].slab, b->scroll_buf[i].cells);
+	free(b->scroll_buf);
+	history_mem -= b->scroll_mem;
+	b->scroll_mem = 0;
+	b->scroll_buf = NULL;
+	b->scroll_alloc = 0;
+	b->scroll_index = 0;
+	b->scroll_above = 0;
+	b->scroll_below = 0;
+}
+
+/* exchanges a row of the viewport with one of the scroll back buffer */
+static void buffer_scroll_swap(Buffer *b, Row *row, Row *slot)
+{
+	size_t in = sizeof(Cell) * row->size, out = sizeof(Cell) * slot->size;
+	Row tmp = *row;
+	*row = *slot;
+	*slot = tmp;
+	b->scroll_mem += in - out;
+	history_mem += in - out;
+}
+
+static Row *buffer_scroll_oldest(Buffer *b)
+{
+	return &b->scroll_buf[(b->scroll_index - b->scroll_above + b->scroll_size) % b->scroll_size];
+}
+
+/* drops the oldest scroll back lines of all buffers until they fit into the
+ * budget again, with some slack to not search for them on every line */
+static void history_trim(void)
+{
+	size_t limit = history_budget - history_budget / 16;
+
+	while (history_mem > limit) {
+		Buffer *oldest = NULL;
+		uint64_t seq = 0, next = UINT64_MAX;
+		for (Buffer *b = history_buffers; b; b = b->scroll_next) {
+			if (!b->scroll_above)
+				continue;
+			uint64_t s = buffer_scroll_oldest(b)->seq;
+			if (!oldest || s < seq) {
+				if (oldest)
+					next = seq;
+				oldest = b;
+				seq = s;
+			} else if (s < next) {
+				next = s;
+			}
+		}
+		if (!oldest)
+			return;
+		/* continue with the same buffer until another one has older lines */
+		do {
+			Row *row = buffer_scroll_oldest(oldest);
+			oldest->scroll_mem -= sizeof(Cell) * row->size;
+			history_mem -= sizeof(Cell) * row->size;
+			slab_free(oldest, row->slab, row->cells);
+			*row = (Row){ 0 };
+			oldest->scroll_above--;
+			oldest->scroll_evicted++;
+		} while (history_mem > limit && oldest->scroll_above &&
+		         buffer_scroll_oldest(oldest)->seq < next);
+	}
+}
+
 static void buffer_scroll(Buffer *b, int s)
 {
 	/* work in screenfuls */
@@ -338,15 +586,18 @@ static void buffer_scroll(Buffer *b, int s)
 		return;
 	}
 
+	if (s > 0 && b->scroll_index + s > b->scroll_alloc && b->scroll_alloc < b->scroll_size)
+		buffer_scroll_grow(b, b->scroll_index + s);
+
 	b->scroll_above += s;
 	if (b->scroll_above >= b->scroll_size)
 		b->scroll_above = b->scroll_size;
 
 	if (s > 0 && b->scroll_size) {
 		for (int i = 0; i < s; i++) {
-			Row tmp = b->scroll_top[i];
-			b->scroll_top[i] = b->scroll_buf[b->scroll_index];
-			b->scroll_buf[b->scroll_index] = tmp;
+			buffer_scroll_swap(b, b->scroll_top + i, b->scroll_buf + b->scroll_index);
+			b->scroll_buf[b->scroll_index].seq = history_seq++;
+			row_fit(b, b->scroll_top + i, b->maxcols);
 
 			b->scroll_index++;
 			if (b->scroll_index == b->scroll_size)
@@ -358,14 +609,15 @@ static void buffer_scroll(Buffer *b, int s)
 		for (int i = (-s) - 1; i >= 0; i--) {
 			b->scroll_index--;
 			if (b->scroll_index == -1)
-				b->scroll_index = b->scroll_size - 1;
+				b->scroll_index = b->scroll_alloc - 1;
 
-			Row tmp = b->scroll_top[i];
-			b->scroll_top[i] = b->scroll_buf[b->scroll_index];
-			b->scroll_buf[b->scroll_index] = tmp;
+			buffer_scroll_swap(b, b->scroll_top + i, b->scroll_buf + b->scroll_index);
+			row_fit(b, b->scroll_top + i, b->maxcols);
 			b->scroll_top[i].dirty = true;
 		}
 	}
+	if (history_budget && history_mem > history_budget)
+		history_trim();
 }
 
 static void buffer_resize(Buffer *b, int rows, int cols)
@@ -378,7 +630,8 @@ static void buffer_resize(Buffer *b, int rows, int cols)
 			buffer_scroll(b, (b->curs_row - b->lines) - rows + 1);
 		}
 		while (b->rows > rows) {
-			free(lines[b->rows - 1].cells);
+			Row *row = lines + b->rows - 1;
+			slab_free(b, row->slab, row->cells);
 			b->rows--;
 		}
 
@@ -386,18 +639,13 @@ static void buffer_resize(Buffer *b, int rows, int cols)
 	}
 
 	if (b->maxcols < cols) {
+		/* the scroll back buffer is left alone, see buffer_scroll */
 		for (int row = 0; row < b->rows; row++) {
-			lines[row].cells = realloc(lines[row].cells, sizeof(Cell) * cols);
+			row_fit(b, lines + row, cols);
 			if (b->cols < cols)
 				row_set(lines + row, b->cols, cols - b->cols, NULL);
 			lines[row].dirty = true;
 		}
-		Row *sbuf = b->scroll_buf;
-		for (int row = 0; row < b->scroll_size; row++) {
-			sbuf[row].cells = realloc(sbuf[row].cells, sizeof(Cell) * cols);
-			if (b->cols < cols)
-				row_set(sbuf + row, b->cols, cols - b->cols, NULL);
-		}
 		b->tabs = realloc(b->tabs, sizeof(*b->tabs) * cols);
 		for (int col = b->cols; col < cols; col++)
 			b->tabs[col] = !(col & 7);
@@ -412,13 +660,14 @@ static void buffer_resize(Buffer *b, int rows, int cols)
 	int deltarows = 0;
 	if (b->rows < rows) {
 		while (b->rows < rows) {
-			lines[b->rows].cells = calloc(b->maxcols, sizeof(Cell));
+			lines[b->rows] = (Row){ 0 };
+			row_fit(b, lines + b->rows, b->maxcols);
 			row_set(lines + b->rows, 0, b->maxcols, b);
 			b->rows++;
 		}
 
 		/* prepare for backfill */
-		if (b->curs_row >= b->scroll_bot - 1) {
+		if (b->scroll_bot && b->curs_row >= b->scroll_bot - 1) {
 			deltarows = b->lines + rows - b->curs_row - 1;
 			if (deltarows > b->scroll_above)
 				deltarows = b->scroll_above;
@@ -443,9 +692,13 @@ static bool buffer_init(Buffer *b, int rows, int cols, int scroll_size)
 	b->curfg = b->curbg = -1;
 	if (scroll_size < 0)
 		scroll_size = 0;
-	if (scroll_size && !(b->scroll_buf = calloc(scroll_size, sizeof(Row))))
-		return false;
 	b->scroll_size = scroll_size;
+	if (scroll_size) {
+		b->scroll_next = history_buffers;
+		if (history_buffers)
+			history_buffers->scroll_prev = b;
+		history_buffers = b;
+	}
 	buffer_resize(b, rows, cols);
 	return true;
 }
@@ -510,7 +763,7 @@ static Row *buffer_row_next(Buffer *b, Row *row)
 		return first;
 	if (row == after_end)
 		return NULL;
-	if (row == &b->scroll_buf[b->scroll_size - 1])
+	if (row == &b->scroll_buf[b->scroll_alloc - 1])
 		return b->scroll_buf;
 	return ++row;
 }
@@ -534,7 +787,7 @@ static Row *buffer_row_prev(Buffer *b, Row *row)
 	if (row == after_start)
 		return last;
 	if (row == b->scroll_buf)
-		return &b->scroll_buf[b->scroll_size - 1];
+		return &b->scroll_buf[b->scroll_alloc - 1];
 	return --row;
 }
 
@@ -558,6 +811,8 @@ static void cursor_line_down(Vt *t)
 {
 	Buffer *b = t->buffer;
 	row_set(b->curs_row, b->cols, b->maxcols - b->cols, NULL);
+	if (b->curs_row->wrap > b->cols)
+		b->curs_row->wrap = b->cols;
 	b->curs_row++;
 	if (b->curs_row < b->scroll_bot)
 		return;
@@ -567,6 +822,7 @@ static void cursor_line_down(Vt *t)
 	b->curs_row = b->scroll_bot - 1;
 	buffer_scroll(b, 1);
 	row_set(b->curs_row, 0, b->cols, b);
+	t->stats.scrolled++;
 }
 
 static void cursor_save(Vt *t)
@@ -725,6 +981,13 @@ static void interpret_csi_ed(Vt *t, int param[], int pcount)
 	Row *row, *start, *end;
 	Buffer *b = t->buffer;
 
+	if (pcount && param[0] == 3) {
+		/* erase saved lines, as introduced by xterm */
+		vt_noscroll(t);
+		buffer_scroll_clear(b);
+		return;
+	}
+
 	attributes_save(t);
 	b->curattrs = A_NORMAL;
 	b->curfg = b->curbg = -1;
@@ -735,7 +998,7 @@ static void interpret_csi_ed(Vt *t, int param[], int pcount)
 	} else if (pcount && param[0] == 1) {
 		start = b->lines;
 		end = b->curs_row;
-		row_set(b->curs_row, 0, b->curs_col + 1, b);
+		row_set(b->curs_row, 0, MIN(b->curs_col + 1, b->cols), b);
 	} else {
 		row_set(b->curs_row, b->curs_col, b->cols - b->curs_col, b);
 		start = b->curs_row + 1;
@@ -816,7 +1079,7 @@ static void interpret_csi_el(Vt *t, int param[], int pcount)
 	Buffer *b = t->buffer;
 	switch (pcount ? param[0] : 0) {
 	case 1:
-		row_set(b->curs_row, 0, b->curs_col + 1, b);
+		row_set(b->curs_row, 0, MIN(b->curs_col + 1, b->cols), b);
 		break;
 	case 2:
 		row_set(b->curs_row, 0, b->cols, b);
@@ -891,6 +1154,80 @@ static void interpret_csi_dl(Vt *t, int param[], int pcount)
 	}
 }
 
+/* prints a character, already translated for the active charset, at the cursor */
+static void put_char(Vt *t, wchar_t wc)
+{
+	int width;
+
+	t->lastwc = wc;
+	if (t->graphmode || (width = wcwidth(wc)) < 1)
+		width = 1;
+
+	Buffer *b = t->buffer;
+	Cell blank_cell = { L'\0', build_attrs(b->curattrs), b->curfg, b->curbg };
+	if (width > b->cols)
+		width = b->cols;
+	if (width == 2 && b->curs_col == b->cols - 1) {
+		b->curs_row->cells[b->curs_col++] = blank_cell;
+		b->curs_row->dirty = true;
+	}
+
+	if (b->curs_col >= b->cols) {
+		b->curs_row->wrap = b->curs_col;
+		b->curs_col = 0;
+		cursor_line_down(t);
+	}
+
+	if (t->insert) {
+		Cell *src = b->curs_row->cells + b->curs_col;
+		Cell *dest = src + width;
+		size_t len = b->cols - b->curs_col - width;
+		memmove(dest, src, len * sizeof *dest);
+	}
+
+	b->curs_row->cells[b->curs_col] = blank_cell;
+	b->curs_row->cells[b->curs_col++].text = wc;
+	b->curs_row->dirty = true;
+	if (width == 2)
+		b->curs_row->cells[b->curs_col++] = blank_cell;
+}
+
+/* Interpret a 'repeat' (REP) sequence, as used by curses for runs of the
+ * same character. Runs beyond the end of the line are cut short, which
+ * bounds the work per sequence. */
+static void interpret_csi_rep(Vt *t, int param[], int pcount)
+{
+	Buffer *b = t->buffer;
+	int n = (pcount && param[0] > 0) ? param[0] : 1;
+
+	if (!t->lastwc)
+		return;
+	n = MIN(n, MAX(b->cols - b->curs_col, 1));
+	while (n-- > 0)
+		put_char(t, t->lastwc);
+}
+
+/* Interpret a 'scroll up' (SU) or 'scroll down' (SD) sequence, the
+ * content of the scrolling region moves while the cursor stays put */
+static void interpret_csi_su(Vt *t, int param[], int pcount, bool up)
+{
+	Buffer *b = t->buffer;
+	int n = (pcount && param[0] > 0) ? param[0] : 1;
+
+	if (n >= b->scroll_bot - b->scroll_top) {
+		for (Row *row = b->scroll_top; row < b->scroll_bot; row++)
+			row_set(row, 0, b->cols, b);
+	} else if (up) {
+		row_roll(b->scroll_top, b->scroll_bot, n);
+		for (Row *row = b->scroll_bot - n; row < b->scroll_bot; row++)
+			row_set(row, 0, b->cols, b);
+	} else {
+		row_roll(b->scroll_top, b->scroll_bot, -n);
+		for (Row *row = b->scroll_top; row < b->scroll_top + n; row++)
+			row_set(row, 0, b->cols, b);
+	}
+}
+
 /* Interpret an 'erase characters' (ECH) sequence */
 static void interpret_csi_ech(Vt *t, int param[], int pcount)
 {
@@ -984,6 +1321,9 @@ static void interpret_csi_priv_mode(Vt *t, int param[], int pcount, bool set)
 		case 1000: /* enable/disable normal mouse tracking */
 			t->mousetrack = set;
 			break;
+		case 2004: /* enable/disable bracketed paste */
+			t->bracketpaste = set;
+			break;
 		}
 	}
 }
@@ -1007,8 +1347,11 @@ static void interpret_csi(Vt *t)
 		} else if (isdigit((unsigned char)*p)) {
 			if (param_count == 0)
 				csiparam[param_count++] = 0;
-			csiparam[param_count - 1] *= 10;
-			csiparam[param_count - 1] += *p - '0';
+			/* saturate instead of overflowing on absurd values */
+			if (csiparam[param_count - 1] < CSI_PARAM_MAX / 10) {
+				csiparam[param_count - 1] *= 10;
+				csiparam[param_count - 1] += *p - '0';
+			}
 		}
 	}
 
@@ -1070,10 +1413,13 @@ static void interpret_csi(Vt *t)
 		interpret_csi_ech(t, csiparam, param_count);
 		break;
 	case 'S': /* SU: scroll up */
-		vt_scroll(t, param_count ? -csiparam[0] : -1);
+		interpret_csi_su(t, csiparam, param_count, true);
 		break;
 	case 'T': /* SD: scroll down */
-		vt_scroll(t, param_count ? csiparam[0] : 1);
+		interpret_csi_su(t, csiparam, param_count, false);
+		break;
+	case 'b': /* REP: repeat the last character */
+		interpret_csi_rep(t, csiparam, param_count);
 		break;
 	case 'Z': /* CBT: cursor backward tabulation */
 		puttab(t, param_count ? -csiparam[0] : -1);
@@ -1081,7 +1427,8 @@ static void interpret_csi(Vt *t)
 	case 'g': /* TBC: tabulation clear */
 		switch (param_count ? csiparam[0] : 0) {
 		case 0:
-			b->tabs[b->curs_col] = false;
+			if (b->curs_col < b->cols)
+				b->tabs[b->curs_col] = false;
 			break;
 		case 3:
 			memset(b->tabs, 0, sizeof(*b->tabs) * b->maxcols);
@@ -1123,6 +1470,7 @@ static void interpret_csi_ri(Vt *t)
 	else {
 		row_roll(b->scroll_top, b->scroll_bot, -1);
 		row_set(b->scroll_top, 0, b->cols, b);
+		t->stats.scrolled++;
 	}
 }
 
@@ -1173,7 +1521,7 @@ static void interpret_osc(Vt *t)
 
 static void try_interpret_escape_seq(Vt *t)
 {
-	char lastchar = t->ebuf[t->elen - 1];
+	char type = *t->ebuf, lastchar = t->ebuf[t->elen - 1];
 
 	if (!*t->ebuf)
 		return;
@@ -1228,7 +1576,8 @@ static void try_interpret_escape_seq(Vt *t)
 		interpret_csi_nel(t);
 		goto handled;
 	case 'H': /* HTS: horizontal tab set */
-		t->buffer->tabs[t->buffer->curs_col] = true;
+		if (t->buffer->curs_col < t->buffer->cols)
+			t->buffer->tabs[t->buffer->curs_col] = true;
 		goto handled;
 	default:
 		goto cancel;
@@ -1236,6 +1585,7 @@ static void try_interpret_escape_seq(Vt *t)
 
 	if (t->elen + 1 >= sizeof(t->ebuf)) {
 cancel:
+		t->stats.cancelled++;
 #ifndef NDEBUG
 		fprintf(stderr, "cancelled: \\033");
 		for (unsigned int i = 0; i < t->elen; i++) {
@@ -1247,9 +1597,17 @@ cancel:
 		}
 		fputc('\n', stderr);
 #endif
-handled:
 		cancel_escape_sequence(t);
 	}
+	return;
+handled:
+	if (type == '[')
+		t->stats.csi++;
+	else if (type == ']')
+		t->stats.osc++;
+	else
+		t->stats.esc++;
+	cancel_escape_sequence(t);
 }
 
 static void puttab(Vt *t, int count)
@@ -1343,11 +1701,10 @@ static wchar_t get_vt100_graphic(char c)
 
 static void put_wc(Vt *t, wchar_t wc)
 {
-	int width = 0;
-
 	if (!t->seen_input) {
 		t->seen_input = 1;
-		kill(-t->pid, SIGWINCH);
+		if (t->pid > 0)
+			kill(-t->pid, SIGWINCH);
 	}
 
 	if (t->escaped) {
@@ -1361,74 +1718,34 @@ static void put_wc(Vt *t, wchar_t wc)
 	} else if (IS_CONTROL(wc)) {
 		process_nonprinting(t, wc);
 	} else {
-		if (t->graphmode) {
-			if (wc >= 0x41 && wc <= 0x7e) {
-				wchar_t gc = get_vt100_graphic(wc);
-				if (gc)
-					wc = gc;
-			}
-			width = 1;
-		} else if ((width = wcwidth(wc)) < 1) {
-			width = 1;
+		if (t->graphmode && wc >= 0x41 && wc <= 0x7e) {
+			wchar_t gc = get_vt100_graphic(wc);
+			if (gc)
+				wc = gc;
 		}
-		Buffer *b = t->buffer;
-		Cell blank_cell = { L'\0', build_attrs(b->curattrs), b->curfg, b->curbg };
-		if (width == 2 && b->curs_col == b->cols - 1) {
-			b->curs_row->cells[b->curs_col++] = blank_cell;
-			b->curs_row->dirty = true;
-		}
-
-		if (b->curs_col >= b->cols) {
-			b->curs_col = 0;
-			cursor_line_down(t);
-		}
-
-		if (t->insert) {
-			Cell *src = b->curs_row->cells + b->curs_col;
-			Cell *dest = src + width;
-			size_t len = b->cols - b->curs_col - width;
-			memmove(dest, src, len * sizeof *dest);
-		}
-
-		b->curs_row->cells[b->curs_col] = blank_cell;
-		b->curs_row->cells[b->curs_col++].text = wc;
-		b->curs_row->dirty = true;
-		if (width == 2)
-			b->curs_row->cells[b->curs_col++] = blank_cell;
+		put_char(t, wc);
 	}
 }
 
-int vt_process(Vt *t)
+/* decode and interpret the pending bytes of the read buffer, an incomplete
+ * multibyte sequence at its end is kept for the next round */
+static void vt_parse(Vt *t)
 {
-	int res;
 	unsigned int pos = 0;
 	mbstate_t ps;
 	memset(&ps, 0, sizeof(ps));
 
-	if (t->pty < 0) {
-		errno = EINVAL;
-		return -1;
-	}
-
-	res = read(t->pty, t->rbuf + t->rlen, sizeof(t->rbuf) - t->rlen);
-	if (res < 0)
-		return -1;
-
-	t->rlen += res;
 	while (pos < t->rlen) {
 		wchar_t wc;
 		ssize_t len;
 
 		len = (ssize_t)mbrtowc(&wc, t->rbuf + pos, t->rlen - pos, &ps);
-		if (len == -2) {
-			t->rlen -= pos;
-			memmove(t->rbuf, t->rbuf + pos, t->rlen);
-			return 0;
-		}
+		if (len == -2)
+			break;
 
 		if (len == -1) {
 			len = 1;
-			wc = t->rbuf[pos];
+			wc = (unsigned char)t->rbuf[pos];
 		}
 
 		pos += len ? len : 1;
@@ -1437,9 +1754,42 @@ int vt_process(Vt *t)
 
 	t->rlen -= pos;
 	memmove(t->rbuf, t->rbuf + pos, t->rlen);
+}
+
+int vt_process(Vt *t)
+{
+	int res;
+
+	if (t->pty < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	res = read(t->pty, t->rbuf + t->rlen, sizeof(t->rbuf) - t->rlen);
+	if (res < 0)
+		return -1;
+
+	t->stats.reads++;
+	t->stats.bytes += res;
+	if (t->tap_handler && res > 0)
+		t->tap_handler(t, t->rbuf + t->rlen, res);
+	t->rlen += res;
+	vt_parse(t);
 	return 0;
 }
 
+void vt_feed(Vt *t, const char *buf, size_t len)
+{
+	while (len > 0) {
+		size_t n = MIN(len, sizeof(t->rbuf) - t->rlen);
+		memcpy(t->rbuf + t->rlen, buf, n);
+		t->rlen += n;
+		buf += n;
+		len -= n;
+		vt_parse(t);
+	}
+}
+
 void vt_default_colors_set(Vt *t, attr_t attrs, short fg, short bg)
 {
 	t->defattrs = attrs;
@@ -1462,6 +1812,7 @@ Vt *vt_create(int rows, int cols, int scroll_size)
 
 	if (!buffer_init(&t->buffer_normal, rows, cols, scroll_size) ||
 	    !buffer_init(&t->buffer_alternate, rows, cols, 0)) {
+		buffer_free(&t->buffer_normal);
 		free(t);
 		return NULL;
 	}
@@ -1469,10 +1820,9 @@ Vt *vt_create(int rows, int cols, int scroll_size)
 	return t;
 }
 
+/* the application is only told about the new size by vt_winsize_sync() */
 void vt_resize(Vt *t, int rows, int cols)
 {
-	struct winsize ws = { .ws_row = rows, .ws_col = cols };
-
 	if (rows <= 0 || cols <= 0)
 		return;
 
@@ -1480,6 +1830,21 @@ void vt_resize(Vt *t, int rows, int cols)
 	buffer_resize(&t->buffer_normal, rows, cols);
 	buffer_resize(&t->buffer_alternate, rows, cols);
 	cursor_clamp(t);
+}
+
+bool vt_winsize_pending(Vt *t)
+{
+	return t->pty >= 0 && (t->ws_rows != t->buffer->rows || t->ws_cols != t->buffer->cols);
+}
+
+void vt_winsize_sync(Vt *t)
+{
+	struct winsize ws = { .ws_row = t->buffer->rows, .ws_col = t->buffer->cols };
+
+	if (!vt_winsize_pending(t))
+		return;
+	t->ws_rows = ws.ws_row;
+	t->ws_cols = ws.ws_col;
 	ioctl(t->pty, TIOCSWINSZ, &ws);
 	kill(-t->pid, SIGWINCH);
 }
@@ -1491,6 +1856,7 @@ void vt_destroy(Vt *t)
 	buffer_free(&t->buffer_normal);
 	buffer_free(&t->buffer_alternate);
 	close(t->pty);
+	free(t->wbuf);
 	free(t);
 }
 
@@ -1518,10 +1884,12 @@ void vt_draw(Vt *t, WINDOW *win, int srow, int scol)
 			continue;
 
 		wmove(win, srow + i, scol);
+		t->stats.repainted++;
 		Cell *cell = NULL;
 		for (int j = 0; j < b->cols; j++) {
 			Cell *prev_cell = cell;
 			cell = row->cells + j;
+			t->stats.cells++;
 			if (!prev_cell || cell->attr != prev_cell->attr
 			    || cell->fg != prev_cell->fg
 			    || cell->bg != prev_cell->bg) {
@@ -1600,6 +1968,8 @@ pid_t vt_forkpty(Vt *t, const char *p, const char *argv[], const char *cwd, cons
 		from = NULL;
 	}
 
+	t->ws_rows = ws.ws_row;
+	t->ws_cols = ws.ws_col;
 	pid_t pid = forkpty(&t->pty, NULL, NULL, &ws);
 	if (pid < 0)
 		return -1;
@@ -1650,6 +2020,8 @@ pid_t vt_forkpty(Vt *t, const char *p, const char *argv[], const char *cwd, cons
 		*from = ed2vt[0];
 	}
 
+	fcntl(t->pty, F_SETFL, fcntl(t->pty, F_GETFL) | O_NONBLOCK);
+
 	return t->pid = pid;
 }
 
@@ -1658,24 +2030,111 @@ int vt_pty_get(Vt *t)
 	return t->pty;
 }
 
-ssize_t vt_write(Vt *t, const char *buf, size_t len)
+/* writes as much as possible without blocking, returns the number of bytes
+ * written or -1 if the pty is no longer usable */
+static ssize_t pty_write(Vt *t, const char *buf, size_t len)
 {
-	ssize_t ret = len;
+	size_t pos = 0;
 
-	while (len > 0) {
-		ssize_t res = write(t->pty, buf, len);
+	while (pos < len) {
+		ssize_t res = write(t->pty, buf + pos, len - pos);
 		if (res < 0) {
-			if (errno != EAGAIN && errno != EINTR)
-				return -1;
-			continue;
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -1;
 		}
+		pos += res;
+	}
+
+	return pos;
+}
+
+/* data which can not be written immediately is queued and written by
+ * vt_write_flush() once the pty becomes writable */
+ssize_t vt_write(Vt *t, const char *buf, size_t len)
+{
+	ssize_t ret = len;
+
+	/* queue behind pending data to preserve the order */
+	if (t->wstart == t->wlen) {
+		ssize_t res = pty_write(t, buf, len);
+		if (res < 0)
+			return -1;
 		buf += res;
 		len -= res;
 	}
 
+	if (len == 0)
+		return ret;
+
+	if (t->wlen + len > t->wsize && t->wstart) {
+		memmove(t->wbuf, t->wbuf + t->wstart, t->wlen - t->wstart);
+		t->wlen -= t->wstart;
+		t->wstart = 0;
+	}
+
+	if (t->wlen + len > t->wsize) {
+		size_t size = MAX(t->wsize * 2, t->wlen + len);
+		char *wbuf = realloc(t->wbuf, size);
+		if (!wbuf)
+			return -1;
+		t->wbuf = wbuf;
+		t->wsize = size;
+	}
+
+	memcpy(t->wbuf + t->wlen, buf, len);
+	t->wlen += len;
 	return ret;
 }
 
+size_t vt_write_pending(Vt *t)
+{
+	return t->wlen - t->wstart;
+}
+
+int vt_write_flush(Vt *t)
+{
+	ssize_t res = pty_write(t, t->wbuf + t->wstart, t->wlen - t->wstart);
+	if (res < 0) {
+		t->wstart = t->wlen = 0;
+		return -1;
+	}
+	t->wstart += res;
+	if (t->wstart == t->wlen)
+		t->wstart = t->wlen = 0;
+	return 0;
+}
+
+/* wraps pasted text in bracketed paste sequences if requested by the
+ * application */
+void vt_paste_begin(Vt *t)
+{
+	if (t->bracketpaste)
+		vt_write(t, "\e[200~", 6);
+}
+
+void vt_paste_end(Vt *t)
+{
+	if (t->bracketpaste)
+		vt_write(t, "\e[201~", 6);
+}
+
+/* writes pasted text, within brackets escape characters are dropped
+ * so that the text can neither end the paste nor inject sequences */
+void vt_paste(Vt *t, const char *buf, size_t len)
+{
+	const char *esc;
+
+	while (t->bracketpaste && (esc = memchr(buf, '\e', len))) {
+		vt_write(t, buf, esc - buf);
+		len -= esc - buf + 1;
+		buf = esc + 1;
+	}
+	vt_write(t, buf, len);
+}
+
 static void send_curs(Vt *t)
 {
 	Buffer *b = t->buffer;
@@ -1857,6 +2316,13 @@ void vt_keytable_set(const char * const keytable_overlay[], int count)
 	}
 }
 
+void vt_history_budget_set(size_t bytes)
+{
+	history_budget = bytes;
+	if (history_budget && history_mem > history_budget)
+		history_trim();
+}
+
 void vt_shutdown(void)
 {
 	free(color2palette);
@@ -1872,6 +2338,11 @@ void vt_urgent_handler_set(Vt *t, vt_urgent_handler_t handler)
 	t->urgent_handler = handler;
 }
 
+void vt_tap_handler_set(Vt *t, vt_tap_handler_t handler)
+{
+	t->tap_handler = handler;
+}
+
 void vt_data_set(Vt *t, void *data)
 {
 	t->data = data;
@@ -1882,6 +2353,15 @@ void *vt_data_get(Vt *t)
 	return t->data;
 }
 
+const VtStats *vt_stats_get(Vt *t)
+{
+	Buffer *b = &t->buffer_normal;
+	t->stats.history = b->scroll_above + b->scroll_below;
+	t->stats.history_bytes = b->scroll_mem;
+	t->stats.evicted = b->scroll_evicted;
+	return &t->stats;
+}
+
 bool vt_cursor_visible(Vt *t)
 {
 	return t->buffer->scroll_below ? false : !t->curshid;
@@ -1892,11 +2372,81 @@ pid_t vt_pid_get(Vt *t)
 	return t->pid;
 }
 
+/* writes the escape sequences switching from the attributes and colors
+ * of prev, if any, to the ones of cell. Returns the end of the written text. */
+static char *cell_attrs_get(Cell *cell, Cell *prev, char *s)
+{
+	int esclen = 0;
+	if (!prev || cell->attr != prev->attr) {
+		attr_t attr = cell->attr << NCURSES_ATTR_SHIFT;
+		esclen = sprintf(s, "\033[0%s%s%s%s%s%sm",
+			attr & A_BOLD ? ";1" : "",
+			attr & A_DIM ? ";2" : "",
+			attr & A_UNDERLINE ? ";4" : "",
+			attr & A_BLINK ? ";5" : "",
+			attr & A_REVERSE ? ";7" : "",
+			attr & A_INVIS ? ";8" : "");
+		if (esclen > 0)
+			s += esclen;
+	}
+	if (!prev || cell->fg != prev->fg || cell->attr != prev->attr) {
+		if (cell->fg == -1)
+			esclen = sprintf(s, "\033[39m");
+		else
+			esclen = sprintf(s, "\033[38;5;%dm", cell->fg);
+		if (esclen > 0)
+			s += esclen;
+	}
+	if (!prev || cell->bg != prev->bg || cell->attr != prev->attr) {
+		if (cell->bg == -1)
+			esclen = sprintf(s, "\033[49m");
+		else
+			esclen = sprintf(s, "\033[48;5;%dm", cell->bg);
+		if (esclen > 0)
+			s += esclen;
+	}
+	return s;
+}
+
+/* serializes the cells [col, col + ncols) of a row into s, trailing blanks
+ * are omitted unless trim is false. Returns the end of the written text. */
+static char *row_content_get(Row *row, int col, int ncols, bool colored, bool trim, Cell **prev_cell, mbstate_t *ps, char *s)
+{
+	static Cell blank = { .text = L'\0', .attr = A_NORMAL, .fg = -1, .bg = -1 };
+	bool wide = false;
+	char *last_non_space = s;
+	for (; ncols-- > 0; col++) {
+		Cell *cell = col < row->size ? row->cells + col : &blank;
+		if (colored) {
+			s = cell_attrs_get(cell, *prev_cell, s);
+			*prev_cell = cell;
+		}
+		if (cell->text) {
+			size_t len = wcrtomb(s, cell->text, ps);
+			if (len == (size_t)-1) {
+				memset(ps, 0, sizeof(*ps));
+				len = 0;
+			}
+			s += len;
+			last_non_space = s;
+			/* the cell following a wide character is part of it */
+			wide = wcwidth(cell->text) > 1;
+		} else if (wide) {
+			wide = false;
+		} else {
+			*s++ = ' ';
+		}
+	}
+
+	return trim ? last_non_space : s;
+}
+
 size_t vt_content_get(Vt *t, char **buf, bool colored)
 {
 	Buffer *b = t->buffer;
 	int lines = b->scroll_above + b->scroll_below + b->rows + 1;
-	size_t size = lines * ((b->cols + 1) * ((colored ? 64 : 0) + MB_CUR_MAX));
+	/* wrapped rows keep their width when the window is narrowed */
+	size_t size = lines * ((b->maxcols + 1) * ((colored ? 64 : 0) + MB_CUR_MAX));
 	mbstate_t ps;
 	memset(&ps, 0, sizeof(ps));
 
@@ -1906,63 +2456,130 @@ size_t vt_content_get(Vt *t, char **buf, bool colored)
 	char *s = *buf;
 	Cell *prev_cell = NULL;
 
+	/* rows which were wrapped are joined with the following one */
 	for (Row *row = buffer_row_first(b); row; row = buffer_row_next(b, row)) {
-		size_t len = 0;
-		char *last_non_space = s;
-		for (int col = 0; col < b->cols; col++) {
-			Cell *cell = row->cells + col;
-			if (colored) {
-				int esclen = 0;
-				if (!prev_cell || cell->attr != prev_cell->attr) {
-					attr_t attr = cell->attr << NCURSES_ATTR_SHIFT;
-					esclen = sprintf(s, "\033[0%s%s%s%s%s%sm",
-						attr & A_BOLD ? ";1" : "",
-						attr & A_DIM ? ";2" : "",
-						attr & A_UNDERLINE ? ";4" : "",
-						attr & A_BLINK ? ";5" : "",
-						attr & A_REVERSE ? ";7" : "",
-						attr & A_INVIS ? ";8" : "");
-					if (esclen > 0)
-						s += esclen;
-				}
-				if (!prev_cell || cell->fg != prev_cell->fg || cell->attr != prev_cell->attr) {
-					if (cell->fg == -1)
-						esclen = sprintf(s, "\033[39m");
-					else
-						esclen = sprintf(s, "\033[38;5;%dm", cell->fg);
-					if (esclen > 0)
-						s += esclen;
-				}
-				if (!prev_cell || cell->bg != prev_cell->bg || cell->attr != prev_cell->attr) {
-					if (cell->bg == -1)
-						esclen = sprintf(s, "\033[49m");
-					else
-						esclen = sprintf(s, "\033[48;5;%dm", cell->bg);
-					if (esclen > 0)
-						s += esclen;
-				}
-				prev_cell = cell;
-			}
-			if (cell->text) {
-				len = wcrtomb(s, cell->text, &ps);
-				if (len > 0)
-					s += len;
-				last_non_space = s;
-			} else if (len) {
-				len = 0;
-			} else {
-				*s++ = ' ';
-			}
+		if (row->wrap && buffer_row_next(b, row)) {
+			s = row_content_get(row, 0, row->wrap, colored, false, &prev_cell, &ps, s);
+		} else {
+			s = row_content_get(row, 0, b->cols, colored, true, &prev_cell, &ps, s);
+			*s++ = '\n';
 		}
+	}
+
+	return s - *buf;
+}
+
+size_t vt_region_get(Vt *t, char **buf, int row, int nrows, int col, int ncols, bool colored)
+{
+	Buffer *b = t->buffer;
+	Row *r = NULL;
+	mbstate_t ps;
+	memset(&ps, 0, sizeof(ps));
+
+	*buf = NULL;
+	if (col < 0)
+		col = 0;
+	if (col >= b->cols)
+		return 0;
+	if (ncols <= 0 || ncols > b->cols - col)
+		ncols = b->cols - col;
+	if (row < -b->scroll_above) {
+		nrows += row + b->scroll_above;
+		row = -b->scroll_above;
+	}
+	if (nrows > b->scroll_above + b->rows + b->scroll_below)
+		nrows = b->scroll_above + b->rows + b->scroll_below;
+	if (nrows <= 0)
+		return 0;
+
+	/* only walk the rows between the screen and the requested ones */
+	if (row >= 0 && row < b->rows) {
+		r = b->lines + row;
+	} else if (row < 0) {
+		for (r = b->lines; r && row++ < 0; r = buffer_row_prev(b, r));
+	} else {
+		for (r = b->lines + b->rows - 1; r && row-- >= b->rows; r = buffer_row_next(b, r));
+	}
 
-		s = last_non_space;
+	if (!r)
+		return 0;
+
+	size_t size = nrows * ((ncols + 1) * ((colored ? 64 : 0) + MB_CUR_MAX));
+	if (!(*buf = malloc(size)))
+		return 0;
+
+	char *s = *buf;
+	Cell *prev_cell = NULL;
+
+	for (; r && nrows-- > 0; r = buffer_row_next(b, r)) {
+		s = row_content_get(r, col, ncols, colored, true, &prev_cell, &ps, s);
 		*s++ = '\n';
 	}
 
 	return s - *buf;
 }
 
+/* appends the rows of b followed by its attributes, scroll region and cursor */
+static char *buffer_screen_get(Buffer *b, mbstate_t *ps, char *s)
+{
+	Cell *prev_cell = NULL;
+
+	s += sprintf(s, "\033[r\033[0m\033[H\033[2J");
+	for (int i = 0; i < b->rows; i++) {
+		s += sprintf(s, "\033[%d;1H", i + 1);
+		s = row_content_get(b->lines + i, 0, b->cols, true, false, &prev_cell, ps, s);
+	}
+
+	/* the application expects its attributes and scroll region to be in effect */
+	Cell cur = { .attr = build_attrs(b->curattrs), .fg = b->curfg, .bg = b->curbg };
+	s = cell_attrs_get(&cur, NULL, s);
+	s += sprintf(s, "\033[%d;%dr", (int)(b->scroll_top - b->lines) + 1, (int)(b->scroll_bot - b->lines));
+	s += sprintf(s, "\033[%d;%dH", (int)(b->curs_row - b->lines) + 1, b->curs_col + 1);
+	return s;
+}
+
+/* serializes the screen, its cursor and the modes affecting input as
+ * escape sequences which reproduce them on a terminal of the same size.
+ * While the alternate screen is active the normal one is serialized
+ * first, to be restored once the application leaves it. */
+size_t vt_screen_get(Vt *t, char **buf)
+{
+	Buffer *b = t->buffer;
+	mbstate_t ps;
+	memset(&ps, 0, sizeof(ps));
+
+	size_t size = 2 * ((b->rows + 1) * ((b->cols + 1) * (64 + MB_CUR_MAX) + 16) + 128) + 128;
+	if (!(*buf = malloc(size)))
+		return 0;
+
+	char *s = *buf;
+
+	if (b == &t->buffer_alternate) {
+		/* entering the alternate screen saves the cursor of the normal one */
+		s = buffer_screen_get(&t->buffer_normal, &ps, s);
+		s += sprintf(s, "\033[?1049h");
+	}
+	s = buffer_screen_get(b, &ps, s);
+	/* the keypad mode is not tracked, only that of the cursor keys */
+	s += sprintf(s, "\033[?1%c\033[?25%c\033[?1000%c\033[?2004%c\033[4%c",
+		t->curskeymode ? 'h' : 'l', t->curshid ? 'l' : 'h',
+		t->mousetrack ? 'h' : 'l', t->bracketpaste ? 'h' : 'l', t->insert ? 'h' : 'l');
+	if (t->graphmode)
+		s += sprintf(s, "\033(0");
+
+	return s - *buf;
+}
+
+/* line of vt_content_get() at which the viewport starts */
 int vt_content_start(Vt *t)
 {
-	return t->buffer->scroll_above;
+	Buffer *b = t->buffer;
+	int line = b->scroll_above;
+	Row *row = buffer_row_first(b);
+
+	for (int i = 0; row && i < b->scroll_above; i++, row = buffer_row_next(b, row)) {
+		if (row->wrap)
+			line--;
+	}
+	return line;
 }
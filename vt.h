@@ -29,27 +29,54 @@
 typedef struct Vt Vt;
 typedef void (*vt_title_handler_t)(Vt*, const char *title);
 typedef void (*vt_urgent_handler_t)(Vt*);
+typedef void (*vt_tap_handler_t)(Vt*, const char *buf, size_t len);
+
+typedef struct {
+	unsigned long long bytes;     /* bytes read from the pty */
+	unsigned long long reads;     /* number of read(2) calls */
+	unsigned long long csi;       /* interpreted control sequences */
+	unsigned long long osc;       /* interpreted operating system commands */
+	unsigned long long esc;       /* other interpreted escape sequences */
+	unsigned long long cancelled; /* unknown or malformed escape sequences */
+	unsigned long long scrolled;  /* rows scrolled by terminal output */
+	unsigned long long repainted; /* rows repainted by vt_draw */
+	unsigned long long cells;     /* cells emitted by vt_draw */
+	unsigned long long evicted;   /* scroll back lines dropped to fit the budget */
+	size_t history_bytes;         /* memory held by the scroll back buffer */
+	int history;                  /* lines in the scroll back buffer */
+} VtStats;
 
 void vt_init(void);
 void vt_shutdown(void);
+void vt_history_budget_set(size_t bytes);
 
 void vt_keytable_set(char const * const keytable_overlay[], int count);
 void vt_default_colors_set(Vt*, attr_t attrs, short fg, short bg);
 void vt_title_handler_set(Vt*, vt_title_handler_t);
 void vt_urgent_handler_set(Vt*, vt_urgent_handler_t);
+void vt_tap_handler_set(Vt*, vt_tap_handler_t);
 void vt_data_set(Vt*, void *);
 void *vt_data_get(Vt*);
+const VtStats *vt_stats_get(Vt*);
 
 Vt *vt_create(int rows, int cols, int scroll_buf_sz);
 void vt_resize(Vt*, int rows, int cols);
+bool vt_winsize_pending(Vt*);
+void vt_winsize_sync(Vt*);
 void vt_destroy(Vt*);
 pid_t vt_forkpty(Vt*, const char *p, const char *argv[], const char *cwd, const char *env[], int *to, int *from);
 int vt_pty_get(Vt*);
 bool vt_cursor_visible(Vt*);
 
 int vt_process(Vt *);
+void vt_feed(Vt *, const char *buf, size_t len);
 void vt_keypress(Vt *, int keycode);
 ssize_t vt_write(Vt*, const char *buf, size_t len);
+size_t vt_write_pending(Vt*);
+int vt_write_flush(Vt*);
+void vt_paste_begin(Vt*);
+void vt_paste_end(Vt*);
+void vt_paste(Vt*, const char *buf, size_t len);
 void vt_mouse(Vt*, int x, int y, mmask_t mask);
 void vt_dirty(Vt*);
 void vt_draw(Vt*, WINDOW *win, int startrow, int startcol);
@@ -61,6 +88,8 @@ void vt_noscroll(Vt*);
 
 pid_t vt_pid_get(Vt*);
 size_t vt_content_get(Vt*, char **s, bool colored);
+size_t vt_region_get(Vt*, char **s, int row, int nrows, int col, int ncols, bool colored);
+size_t vt_screen_get(Vt*, char **s);
 int vt_content_start(Vt*);
 
 #endif /* VT_H */